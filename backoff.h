@@ -0,0 +1,142 @@
+#ifndef __BACKOFF_H__
+#define __BACKOFF_H__
+
+#include "futex.h"
+
+#include <atomic>
+#include <thread>
+
+#include <stdint.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+// spin-wait hint: frees the pipeline for the sibling hyperthread and takes the core
+// off the memory bus for a few dozen cycles, no syscall
+static inline void CpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+    _mm_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield" ::: "memory");
+#else
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+#endif
+}
+
+// backoff policies of the retry loops, Options::Backoff of FixedQueue, LinkedQueue and
+// FreeAllocate. every loop makes its own object on the stack and calls after each miss:
+//   Retry(): a CAS was lost, so another thread has made progress and a new try may
+//            succeed right away. no policy gives up the cpu here
+//   Wait():  another thread has claimed what we need (a slot still being written or
+//            read) and we can do nothing but wait for it to finish
+// a policy is any default constructible class with these two members
+
+// today's behavior: lost CAS are retried at once, waits yield
+struct BackoffDefault {
+    void Retry() {}
+
+    void Wait() {
+        std::this_thread::yield();
+    }
+};
+
+// 1, 2, 4 ... MaxSpins pauses per call
+template<unsigned MaxSpins>
+class BackoffPauseSpin {
+public:
+    void Spin() {
+        for(unsigned i = 0; i < m_spins; ++i) {
+            CpuRelax();
+        }
+
+        if(m_spins < MaxSpins) {
+            m_spins <<= 1;
+        }
+    }
+
+private:
+    unsigned m_spins = 1;
+};
+
+// exponential _mm_pause for retries and waits, never leaves the cpu. best when every
+// thread has a core, worst when a waited for thread is descheduled
+template<unsigned MaxSpins = 1024>
+class BackoffExponentialPause {
+public:
+    void Retry() {
+        m_spin.Spin();
+    }
+
+    void Wait() {
+        m_spin.Spin();
+    }
+
+private:
+    BackoffPauseSpin<MaxSpins> m_spin;
+};
+
+// exponential _mm_pause, a wait yields once it has spun SpinCount times
+template<unsigned SpinCount = 10, unsigned MaxSpins = 256>
+class BackoffSpinYield {
+public:
+    void Retry() {
+        m_spin.Spin();
+    }
+
+    void Wait() {
+        if(m_waits < SpinCount) {
+            ++m_waits;
+            m_spin.Spin();
+        } else {
+            std::this_thread::yield();
+        }
+    }
+
+private:
+    BackoffPauseSpin<MaxSpins> m_spin;
+    unsigned m_waits = 0;
+};
+
+// exponential _mm_pause, then YieldCount yields, then a wait parks in FutexWait for
+// MinParkNs, doubled per call up to MaxParkNs. nobody wakes the park word, the waited
+// for slot has no waker: the timeout bounds the sleep. for threads far outnumbering
+// cores, where a waiter that keeps yielding steals time from the thread it waits for
+template<unsigned SpinCount = 10, unsigned YieldCount = 4, long MinParkNs = 2000, long MaxParkNs = 1000000>
+class BackoffSpinPark {
+public:
+    void Retry() {
+        m_spin.Spin();
+    }
+
+    void Wait() {
+        if(m_waits < SpinCount) {
+            ++m_waits;
+            m_spin.Spin();
+        } else if(m_waits < SpinCount + YieldCount) {
+            ++m_waits;
+            std::this_thread::yield();
+        } else {
+            Park();
+        }
+    }
+
+private:
+    void Park() {
+        struct timespec ts;
+        ts.tv_sec = m_park_ns / 1000000000L;
+        ts.tv_nsec = m_park_ns % 1000000000L;
+
+        FutexWait(&m_park_word, 0, &ts);
+
+        m_park_ns = m_park_ns < MaxParkNs / 2 ? m_park_ns * 2 : MaxParkNs;
+    }
+
+    BackoffPauseSpin<256> m_spin;
+    unsigned m_waits = 0;
+    long m_park_ns = MinParkNs;
+    std::atomic<uint32_t> m_park_word = ATOMIC_VAR_INIT(0);
+};
+
+#endif
@@ -0,0 +1,241 @@
+#include "fixed_queue.h"
+#include "linked_queue.h"
+#include "sharded_queue.h"
+#include "latency_histogram.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <memory>
+#include <chrono>
+
+// usage: baseline_bench.out [seconds_per_run] [max_threads]
+//
+// the workload of fixed_queue_test_2.cpp and linked_queue_test.cpp: producers move
+// elements holding a small heap vector into the queue, consumers move them out.
+// FixedQueue and LinkedQueue against a std::mutex + std::deque queue and a ring behind
+// a spinlock, all bounded at the same capacity. half of the threads push and the rest
+// pop. ops/sec counts successful Push + Pop, latency is push-to-pop of each element.
+// sharded_queue is one FixedQueue per NUMA node, each of that capacity.
+
+static constexpr size_t BenchCapacity = 100000;
+
+static uint64_t NowNs() {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct UserData {
+    int topic = 0;
+    unsigned long counter = 0;
+    uint64_t timestamp = 0;
+    std::vector<int> xx = {1,2,3,4,5,6,7,8,9,10,};
+};
+
+// std::deque under std::mutex, refuses pushes beyond capacity like the lock free queues
+template<typename ElementType>
+class MutexDequeQueue {
+public:
+    explicit MutexDequeQueue(size_t capacity) : m_capacity(capacity) {}
+
+    template<typename ... Args>
+    bool Push(Args && ... args) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        if(m_deque.size() == m_capacity) {
+            return false;
+        }
+
+        m_deque.emplace_back(std::forward<Args>(args) ...);
+        return true;
+    }
+
+    template<typename OutType>
+    bool Pop(OutType *out) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        if(m_deque.empty()) {
+            return false;
+        }
+
+        *out = std::move(m_deque.front());
+        m_deque.pop_front();
+        return true;
+    }
+
+private:
+    std::mutex m_mutex;
+    std::deque<ElementType> m_deque;
+    size_t m_capacity;
+};
+
+// preallocated ring under a test-and-test-and-set spinlock
+template<typename ElementType>
+class SpinlockRingQueue {
+public:
+    explicit SpinlockRingQueue(size_t capacity) : m_slots(capacity) {}
+
+    template<typename ... Args>
+    bool Push(Args && ... args) {
+        Lock();
+
+        if(m_size == m_slots.size()) {
+            Unlock();
+            return false;
+        }
+
+        m_slots[(m_head + m_size) % m_slots.size()] = ElementType(std::forward<Args>(args) ...);
+        ++m_size;
+
+        Unlock();
+        return true;
+    }
+
+    template<typename OutType>
+    bool Pop(OutType *out) {
+        Lock();
+
+        if(!m_size) {
+            Unlock();
+            return false;
+        }
+
+        *out = std::move(m_slots[m_head]);
+        m_head = (m_head + 1u) % m_slots.size();
+        --m_size;
+
+        Unlock();
+        return true;
+    }
+
+private:
+    void Lock() {
+        for(int i = 0; m_lock.exchange(true, std::memory_order_acquire); ) {
+            while(m_lock.load(std::memory_order_relaxed)) {
+                if(++i % 64 == 0) {
+                    // the holder may be descheduled
+                    std::this_thread::yield();
+                }
+            }
+        }
+    }
+
+    void Unlock() {
+        m_lock.store(false, std::memory_order_release);
+    }
+
+    alignas(CacheLineSize) std::atomic<bool> m_lock = ATOMIC_VAR_INIT(false);
+    std::vector<ElementType> m_slots;
+    size_t m_head = 0;
+    size_t m_size = 0;
+};
+
+template<typename Queue>
+static std::unique_ptr<Queue> MakeQueue() {
+    return std::make_unique<Queue>(BenchCapacity);
+}
+
+template<>
+std::unique_ptr<FixedQueue<UserData, BenchCapacity>> MakeQueue() {
+    return std::make_unique<FixedQueue<UserData, BenchCapacity>>();
+}
+
+template<typename Queue>
+static void Run(const char *name, int threads, double seconds) {
+    std::unique_ptr<Queue> q_p = MakeQueue<Queue>();
+    Queue &q = *q_p;
+
+    std::atomic<int> start = ATOMIC_VAR_INIT(0);
+    std::atomic<int> stop = ATOMIC_VAR_INIT(0);
+    std::atomic<unsigned long long> ops = ATOMIC_VAR_INIT(0);
+
+    int producers = threads / 2;
+    int consumers = threads - producers;
+
+    std::vector<LatencyHistogram<>> histograms(consumers);
+    std::vector<std::thread> workers;
+
+    for(int i = 0; i < producers; ++i) {
+        workers.emplace_back([&, i]() {
+                unsigned long long n = 0;
+                unsigned long counter = 0;
+                while(!start.load(std::memory_order_acquire));
+                while(!stop.load(std::memory_order_relaxed)) {
+                    UserData ud;
+                    ud.topic = i;
+                    ud.counter = counter;
+                    ud.timestamp = NowNs();
+
+                    if(q.Push(std::move(ud))) {
+                        ++counter;
+                        ++n;
+                    }
+                }
+                ops.fetch_add(n, std::memory_order_relaxed);
+                });
+    }
+
+    for(int i = 0; i < consumers; ++i) {
+        workers.emplace_back([&, i]() {
+                LatencyHistogram<> &histogram = histograms[i];
+                unsigned long long n = 0;
+                while(!start.load(std::memory_order_acquire));
+                while(!stop.load(std::memory_order_relaxed)) {
+                    UserData ud;
+
+                    if(q.Pop(&ud)) {
+                        uint64_t now = NowNs();
+                        histogram.Record(now > ud.timestamp ? now - ud.timestamp : 0);
+                        ++n;
+                    }
+                }
+                ops.fetch_add(n, std::memory_order_relaxed);
+                });
+    }
+
+    auto begin = std::chrono::steady_clock::now();
+    start.store(1, std::memory_order_release);
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+    stop.store(1, std::memory_order_relaxed);
+
+    for(size_t i = 0; i < workers.size(); ++i) {
+        workers[i].join();
+    }
+
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    LatencyHistogram<> latency;
+    for(int i = 0; i < consumers; ++i) {
+        latency.Merge(histograms[i]);
+    }
+
+    // leave nothing behind for the queue destructors
+    UserData ud;
+    while(q.Pop(&ud));
+
+    printf("%-14s threads=%-3d ops/sec=%-10.0f p50_ns=%-9lu p99_ns=%-9lu p999_ns=%-9lu max_ns=%lu\n",
+            name, threads, ops.load() / elapsed, (unsigned long)latency.Percentile(50.0),
+            (unsigned long)latency.Percentile(99.0), (unsigned long)latency.Percentile(99.9),
+            (unsigned long)latency.GetMax());
+    fflush(stdout);
+}
+
+int main(int argc, char **argv) {
+    double seconds = argc > 1 ? atof(argv[1]) : 1.0;
+    int max_threads = argc > 2 ? atoi(argv[2]) : 16;
+
+    printf("== lock free against locked queues, capacity=%lu ==\n", (unsigned long)BenchCapacity);
+
+    for(int threads = 2; threads <= max_threads; threads *= 2) {
+        Run<FixedQueue<UserData, BenchCapacity>>("fixed_queue", threads, seconds);
+        Run<LinkedQueue<UserData>>("linked_queue", threads, seconds);
+        Run<ShardedQueue<FixedQueue<UserData, FixedQueueDynamicCapacity, FixedQueueSequenceOptions>>>("sharded_queue", threads, seconds);
+        Run<MutexDequeQueue<UserData>>("mutex_deque", threads, seconds);
+        Run<SpinlockRingQueue<UserData>>("spinlock_ring", threads, seconds);
+    }
+
+    return 0;
+}
@@ -0,0 +1,166 @@
+#include "broadcast_ring.h"
+#include "fixed_queue.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread>
+#include <vector>
+#include <memory>
+#include <chrono>
+
+// usage: broadcast_bench.out [seconds_per_run] [max_subscribers]
+//
+// one producer fans messages out to 1, 2, 4 ... max_subscribers subscribers.
+// broadcast_*: one BroadcastRing, the producer writes each message once.
+// queue_fanout: one SPSC FixedQueue per subscriber, the producer pushes a copy into
+// each, a full queue is retried. msgs/sec counts messages the producer published,
+// deliveries/sec counts messages subscribers received
+
+static constexpr size_t BenchCapacity = 4096;
+
+struct Message {
+    uint64_t sequence;
+    uint64_t payload[7];
+};
+
+static void Report(const char *name, int subscribers, unsigned long long published, unsigned long long delivered, double elapsed) {
+    printf("%-20s subscribers=%-4d msgs/sec=%-12.0f deliveries/sec=%.0f\n",
+            name, subscribers, published / elapsed, delivered / elapsed);
+    fflush(stdout);
+}
+
+template<typename Options>
+static void RunBroadcast(const char *name, int subscribers, double seconds) {
+    using Ring = BroadcastRing<Message, Options>;
+
+    std::unique_ptr<Ring> ring = std::make_unique<Ring>(BenchCapacity);
+    std::vector<size_t> ids(subscribers);
+
+    for(int i = 0; i < subscribers; ++i) {
+        ring->Subscribe(&ids[i]);
+    }
+
+    std::atomic<int> stop = ATOMIC_VAR_INIT(0);
+    std::atomic<unsigned long long> delivered = ATOMIC_VAR_INIT(0);
+    std::vector<std::thread> readers;
+
+    for(int i = 0; i < subscribers; ++i) {
+        readers.emplace_back([&, i]() {
+                unsigned long long n = 0;
+                Message m;
+
+                while(!stop.load(std::memory_order_relaxed)) {
+                    if(ring->Pop(ids[i], &m)) {
+                        ++n;
+                    }
+                }
+
+                delivered.fetch_add(n, std::memory_order_relaxed);
+                });
+    }
+
+    Message m = {};
+    unsigned long long published = 0;
+    auto begin = std::chrono::steady_clock::now();
+    auto end = begin + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(seconds));
+
+    while(std::chrono::steady_clock::now() < end) {
+        for(int i = 0; i < 256; ++i) {
+            m.sequence = published;
+
+            if(ring->Push(m)) {
+                ++published;
+            } else {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    stop.store(1, std::memory_order_relaxed);
+
+    for(size_t i = 0; i < readers.size(); ++i) {
+        readers[i].join();
+    }
+
+    Report(name, subscribers, published, delivered.load(), elapsed);
+}
+
+static void RunQueueFanout(int subscribers, double seconds) {
+    using Queue = FixedQueue<Message, FixedQueueDynamicCapacity, FixedQueueSpscOptions>;
+
+    std::vector<std::unique_ptr<Queue>> queues;
+
+    for(int i = 0; i < subscribers; ++i) {
+        queues.emplace_back(std::make_unique<Queue>(BenchCapacity));
+    }
+
+    std::atomic<int> stop = ATOMIC_VAR_INIT(0);
+    std::atomic<unsigned long long> delivered = ATOMIC_VAR_INIT(0);
+    std::vector<std::thread> readers;
+
+    for(int i = 0; i < subscribers; ++i) {
+        readers.emplace_back([&, i]() {
+                unsigned long long n = 0;
+                Message m;
+
+                while(!stop.load(std::memory_order_relaxed)) {
+                    if(queues[i]->Pop(&m)) {
+                        ++n;
+                    }
+                }
+
+                delivered.fetch_add(n, std::memory_order_relaxed);
+                });
+    }
+
+    Message m = {};
+    unsigned long long published = 0;
+    auto begin = std::chrono::steady_clock::now();
+    auto end = begin + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(seconds));
+
+    while(std::chrono::steady_clock::now() < end) {
+        for(int i = 0; i < 256; ++i) {
+            m.sequence = published;
+
+            // a message is published once every subscriber has its copy
+            for(int j = 0; j < subscribers; ) {
+                if(queues[j]->Push(m)) {
+                    ++j;
+                } else if(std::chrono::steady_clock::now() < end) {
+                    std::this_thread::yield();
+                } else {
+                    break;
+                }
+            }
+
+            ++published;
+        }
+    }
+
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    stop.store(1, std::memory_order_relaxed);
+
+    for(size_t i = 0; i < readers.size(); ++i) {
+        readers[i].join();
+    }
+
+    Report("queue_fanout", subscribers, published, delivered.load(), elapsed);
+}
+
+int main(int argc, char **argv) {
+    double seconds = argc > 1 ? atof(argv[1]) : 1.0;
+    int max_subscribers = argc > 2 ? atoi(argv[2]) : 8;
+
+    printf("== one producer, capacity=%lu, message=%lu bytes ==\n", (unsigned long)BenchCapacity, (unsigned long)sizeof(Message));
+
+    for(int subscribers = 1; subscribers <= max_subscribers; subscribers *= 2) {
+        RunBroadcast<BroadcastRingDefaultOptions>("broadcast_block", subscribers, seconds);
+        RunBroadcast<BroadcastRingOverwriteOptions>("broadcast_overwrite", subscribers, seconds);
+        RunQueueFanout(subscribers, seconds);
+    }
+
+    return 0;
+}
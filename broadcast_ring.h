@@ -0,0 +1,334 @@
+#ifndef __BROADCAST_RING_H__
+#define __BROADCAST_RING_H__
+
+#include "cache_line.h"
+#include "mapped_memory.h"
+#include "backoff.h"
+
+#include <atomic>
+#include <type_traits>
+#include <new>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+#include <stdio.h>
+
+#define ASSERT_LOG(cond, fmt, ...) \
+    if(!(cond)) {\
+        fprintf(stderr, "[%s:%d:%s] " fmt "\n", __FILE__, __LINE__, __FUNCTION__, ##__VA_ARGS__);\
+        assert(0);\
+    }
+
+/*
+#define ASSERT_LOG(cond, fmt, ...) \
+    if(!(cond)) {}
+*/
+
+enum BROADCAST_RING_SLOW_READER {
+    // Push() fails while the slowest subscriber is a whole ring behind, nothing is lost
+    BROADCAST_RING_BLOCK_WRITER = 0,
+    // Push() never waits for subscribers, a subscriber a whole ring behind loses the
+    // overwritten elements and counts them, see GetOverruns()
+    BROADCAST_RING_OVERWRITE,
+};
+
+struct BroadcastRingDefaultOptions {
+    static constexpr int SlowReader = BROADCAST_RING_BLOCK_WRITER;
+    // false when only one thread ever calls Push: the write cursor is advanced by
+    // plain store instead of CAS or fetch_add
+    static constexpr bool MultiWriter = true;
+    // cursor slots, Subscribe() fails when all are taken
+    static constexpr size_t MaxSubscribers = 64;
+    // what cursor CAS retries and slot waits do after a miss, see backoff.h
+    using Backoff = BackoffDefault;
+};
+
+struct BroadcastRingOverwriteOptions : BroadcastRingDefaultOptions {
+    static constexpr int SlowReader = BROADCAST_RING_OVERWRITE;
+};
+
+// every subscriber sees every element: one copy per element in a ring of sequence
+// slots, like FIXED_QUEUE_PROTOCOL_SEQUENCE, and one read cursor per subscriber.
+// a writer claims pos, waits until the slot's previous pos is written, and publishes
+// the element by the slot sequence. a reader copies the slot out and checks the
+// sequence did not move meanwhile (seqlock), so it never writes shared lines but its
+// own cursor. per element the ring costs one slot write, whatever the subscribers.
+// with BROADCAST_RING_BLOCK_WRITER writers check the slowest cursor, cached in
+// m_gate and rescanned only when a writer gets a ring ahead of it.
+// elements are copied word by word through relaxed atomics while a writer may
+// overwrite them, so ElementType must be trivially copyable
+template<typename ElementType, typename Options = BroadcastRingDefaultOptions>
+class BroadcastRing {
+    static_assert(std::is_trivially_copyable<ElementType>::value, "ElementType is copied by racing threads, it must be trivially copyable");
+    static_assert(Options::MaxSubscribers > 0, "a ring needs a subscriber slot");
+
+public:
+    // capacity is rounded up to a power of two. throw std::bad_alloc if slots can not be mapped
+    explicit BroadcastRing(size_t capacity, const MappedMemoryOptions &memory_options = MappedMemoryOptions()) {
+        size_t ring_size = RoundUpPowerOfTwo(capacity);
+        void *p = MappedMemoryAllocate(ring_size * sizeof(Slot), memory_options, &m_mapped_bytes);
+
+        if(!p) {
+            throw std::bad_alloc();
+        }
+
+        m_slots = (Slot *)p;
+        m_ring_mask = ring_size - 1u;
+
+        for(size_t i = 0; i < ring_size; ++i) {
+            new (&m_slots[i]) Slot();
+        }
+    }
+
+    ~BroadcastRing() {
+        // Slot is trivially destructible
+        MappedMemoryFree(m_slots, m_mapped_bytes);
+    }
+
+    // take a cursor slot, *subscriber receives its index. the subscriber sees the
+    // elements pushed from about now on. false if MaxSubscribers are subscribed
+    bool Subscribe(size_t *subscriber) {
+        for(size_t i = 0; i < Options::MaxSubscribers; ++i) {
+            Cursor &cursor = m_cursors[i];
+            size_t expected = Unsubscribed;
+            size_t write = m_write.load(std::memory_order_seq_cst);
+
+            if(cursor.read.load(std::memory_order_relaxed) != Unsubscribed ||
+                    !cursor.read.compare_exchange_strong(expected, write, std::memory_order_seq_cst)) {
+                continue;
+            }
+
+            // a writer that claimed pos before it could see this cursor may still
+            // overwrite pos up to the write cursor read now, start there
+            cursor.overruns.store(0, std::memory_order_relaxed);
+            cursor.read.store(m_write.load(std::memory_order_seq_cst), std::memory_order_seq_cst);
+
+            *subscriber = i;
+            return true;
+        }
+
+        return false;
+    }
+
+    // give the cursor slot back, writers no longer wait for it. the subscriber's
+    // thread only, not while it is in Pop()
+    void Unsubscribe(size_t subscriber) {
+        m_cursors[subscriber].read.store(Unsubscribed, std::memory_order_release);
+    }
+
+    // BROADCAST_RING_BLOCK_WRITER: false while the slowest subscriber is a ring behind.
+    // BROADCAST_RING_OVERWRITE: always true
+    bool Push(const ElementType &elem) {
+        size_t write;
+
+        if(!ClaimWrite(&write)) {
+            return false;
+        }
+
+        Slot &slot = SlotAt(write);
+        size_t previous = write > m_ring_mask ? Written(write - m_ring_mask - 1u) : 0;
+        typename Options::Backoff backoff;
+
+        // a writer of the previous lap, or of a lap before with BROADCAST_RING_OVERWRITE,
+        // has not finished this slot yet
+        while(slot.sequence.load(std::memory_order_acquire) != previous) {
+            backoff.Wait();
+        }
+
+        uint64_t words[WordCount] = {};
+        memcpy(words, &elem, sizeof(ElementType));
+
+        // odd: readers of the old pos see the slot is being written
+        slot.sequence.store(Writing(write), std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        for(size_t i = 0; i < WordCount; ++i) {
+            slot.words[i].store(words[i], std::memory_order_relaxed);
+        }
+
+        slot.sequence.store(Written(write), std::memory_order_release);
+
+        return true;
+    }
+
+    // BROADCAST_RING_BLOCK_WRITER: push, Backoff::Wait() while the ring is full
+    void PushWait(const ElementType &elem) {
+        typename Options::Backoff backoff;
+
+        while(!Push(elem)) {
+            backoff.Wait();
+        }
+    }
+
+    // the subscriber's thread only. next element of the subscriber, false if nothing
+    // new is written yet. with BROADCAST_RING_OVERWRITE a subscriber that was a ring
+    // behind first skips to the oldest element still in the ring
+    bool Pop(size_t subscriber, ElementType *out) {
+        Cursor &cursor = m_cursors[subscriber];
+        size_t read = cursor.read.load(std::memory_order_relaxed);
+
+        ASSERT_LOG(read != Unsubscribed, "subscriber=%lu is not subscribed", (unsigned long)subscriber);
+
+        for(;;) {
+            Slot &slot = SlotAt(read);
+            size_t sequence = slot.sequence.load(std::memory_order_acquire);
+
+            if(sequence < Written(read)) {
+                // pos not written yet, or its writer is still at it
+                return false;
+            }
+
+            uint64_t words[WordCount];
+
+            if(sequence == Written(read)) {
+                for(size_t i = 0; i < WordCount; ++i) {
+                    words[i] = slot.words[i].load(std::memory_order_relaxed);
+                }
+
+                // the copy is done before the sequence is checked again
+                std::atomic_thread_fence(std::memory_order_acquire);
+
+                if(slot.sequence.load(std::memory_order_relaxed) == sequence) {
+                    memcpy((void *)out, words, sizeof(ElementType));
+                    cursor.read.store(read + 1u, std::memory_order_release);
+
+                    return true;
+                }
+            }
+
+            // a writer of a later lap took the slot
+            ASSERT_LOG(Options::SlowReader == BROADCAST_RING_OVERWRITE, "subscriber=%lu overrun, read=%lu",
+                    (unsigned long)subscriber, (unsigned long)read);
+
+            size_t write = m_write.load(std::memory_order_acquire);
+            size_t oldest = write > m_ring_mask ? write - m_ring_mask - 1u : 0;
+            size_t skip_to = oldest > read ? oldest : read + 1u;
+
+            cursor.overruns.fetch_add(skip_to - read, std::memory_order_relaxed);
+            cursor.read.store(skip_to, std::memory_order_release);
+            read = skip_to;
+        }
+    }
+
+    // BROADCAST_RING_OVERWRITE: elements the subscriber lost to writers since it subscribed
+    unsigned long long GetOverruns(size_t subscriber) const {
+        return m_cursors[subscriber].overruns.load(std::memory_order_relaxed);
+    }
+
+    // elements the subscriber has yet to pop, more than the ring holds after an overrun
+    size_t ApproximateSize(size_t subscriber) const {
+        size_t read = m_cursors[subscriber].read.load(std::memory_order_relaxed);
+        size_t write = m_write.load(std::memory_order_relaxed);
+
+        return read != Unsubscribed && write > read ? write - read : 0;
+    }
+
+    size_t GetCapacity() const {
+        return m_ring_mask + 1u;
+    }
+
+private:
+    BroadcastRing(const BroadcastRing &);
+    BroadcastRing(BroadcastRing &&);
+    BroadcastRing &operator=(const BroadcastRing &);
+    BroadcastRing &operator=(BroadcastRing &&);
+
+    static constexpr size_t WordCount = (sizeof(ElementType) + sizeof(uint64_t) - 1u) / sizeof(uint64_t);
+
+    // sequence: 0 before the first write, Writing(pos) while pos is written, then
+    // Written(pos) until a writer of pos + ring size comes
+    struct Slot {
+        std::atomic<size_t> sequence = ATOMIC_VAR_INIT(0);
+        std::atomic<uint64_t> words[WordCount];
+    };
+
+    // read cursor of one subscriber, on its own cache line
+    struct alignas(CacheLineSize) Cursor {
+        std::atomic<size_t> read = ATOMIC_VAR_INIT(Unsubscribed); // next pos to read
+        std::atomic<unsigned long long> overruns = ATOMIC_VAR_INIT(0);
+    };
+
+    static constexpr size_t Unsubscribed = SIZE_MAX;
+
+    static constexpr size_t Writing(size_t pos) {
+        return pos * 2u + 1u;
+    }
+
+    static constexpr size_t Written(size_t pos) {
+        return pos * 2u + 2u;
+    }
+
+    Slot &SlotAt(size_t pos) {
+        return m_slots[pos & m_ring_mask];
+    }
+
+    // slowest subscribed cursor, or write if nobody is subscribed
+    size_t ScanGate(size_t write) {
+        size_t gate = write;
+
+        for(size_t i = 0; i < Options::MaxSubscribers; ++i) {
+            size_t read = m_cursors[i].read.load(std::memory_order_seq_cst);
+
+            if(read < gate) {
+                gate = read;
+            }
+        }
+
+        m_gate.store(gate, std::memory_order_relaxed);
+
+        return gate;
+    }
+
+    bool ClaimWrite(size_t *write) {
+        if constexpr (Options::SlowReader == BROADCAST_RING_OVERWRITE) {
+            if constexpr (Options::MultiWriter) {
+                *write = m_write.fetch_add(1u, std::memory_order_seq_cst);
+            } else {
+                *write = m_write.load(std::memory_order_relaxed);
+                m_write.store(*write + 1u, std::memory_order_seq_cst);
+            }
+
+            return true;
+        } else {
+            typename Options::Backoff backoff;
+            size_t w = m_write.load(std::memory_order_seq_cst);
+
+            for(;;) {
+                // a subscriber at gate still has to read pos gate, which pos
+                // gate + ring size overwrites
+                if(w - m_gate.load(std::memory_order_relaxed) > m_ring_mask && w - ScanGate(w) > m_ring_mask) {
+                    // ring is full
+                    return false;
+                }
+
+                if constexpr (Options::MultiWriter) {
+                    if(m_write.compare_exchange_weak(w, w + 1u, std::memory_order_seq_cst, std::memory_order_seq_cst)) {
+                        break;
+                    }
+
+                    backoff.Retry();
+                } else {
+                    m_write.store(w + 1u, std::memory_order_seq_cst);
+                    break;
+                }
+            }
+
+            *write = w;
+            return true;
+        }
+    }
+
+    Slot *m_slots = nullptr;
+    size_t m_ring_mask = 0;
+    size_t m_mapped_bytes = 0;
+
+    alignas(CacheLineSize) std::atomic<size_t> m_write = ATOMIC_VAR_INIT(0); // next write pos
+    std::atomic<size_t> m_gate = ATOMIC_VAR_INIT(0); // BROADCAST_RING_BLOCK_WRITER: slowest cursor seen last
+    Cursor m_cursors[Options::MaxSubscribers];
+};
+
+#undef ASSERT_LOG
+
+#endif
@@ -0,0 +1,203 @@
+#include "broadcast_ring.h"
+
+#include <vector>
+#include <thread>
+
+#include <signal.h>
+
+// pushers write their counters into one ring, every subscriber checks it sees each
+// producer's counters in order and no torn element. BROADCAST_RING_BLOCK_WRITER:
+// every subscriber gets every element. BROADCAST_RING_OVERWRITE: subscribers fall
+// behind, popped + overruns must still add up to all pushed. one more subscriber
+// keeps subscribing and unsubscribing while the others run
+
+static constexpr int Pushers = 2;
+static constexpr int Subscribers = 3;
+static constexpr size_t Capacity = 1024;
+
+static std::atomic<int> stop = ATOMIC_VAR_INIT(0);
+
+static void sig_handler(int sig) {
+    stop.store(1, std::memory_order_relaxed);
+}
+
+struct Element {
+    unsigned long producer = 0;
+    unsigned long counter = 0;
+    unsigned long check = 0;
+
+    static unsigned long Check(unsigned long producer, unsigned long counter) {
+        return (producer * 0x9e3779b97f4a7c15UL) ^ (counter * 0xbf58476d1ce4e5b9UL);
+    }
+};
+
+template<typename Options>
+static int run(const char *name) {
+    constexpr bool Overwrite = Options::SlowReader == BROADCAST_RING_OVERWRITE;
+
+    std::unique_ptr<BroadcastRing<Element, Options>> ring = std::make_unique<BroadcastRing<Element, Options>>(Capacity);
+
+    std::atomic<int> pushers_done(0);
+    std::atomic<unsigned long long> errors(0);
+    std::vector<unsigned long> pushed(Pushers, 0);
+    std::vector<unsigned long long> popped(Subscribers, 0);
+    std::vector<size_t> subscribers(Subscribers);
+
+    // before any push, so they see everything
+    for(int i = 0; i < Subscribers; ++i) {
+        if(!ring->Subscribe(&subscribers[i])) {
+            fprintf(stderr, "%s subscribe failed\n", name);
+            return 1;
+        }
+    }
+
+    std::vector<std::thread> pushers;
+    std::vector<std::thread> readers;
+
+    for(int i = 0; i < Pushers; ++i) {
+        pushers.emplace_back([&, i]() {
+                Element e;
+                e.producer = i;
+
+                while(!stop.load(std::memory_order_relaxed)) {
+                    e.check = Element::Check(e.producer, e.counter);
+
+                    if(ring->Push(e)) {
+                        ++e.counter;
+                    } else {
+                        std::this_thread::yield();
+                    }
+                }
+
+                pushed[i] = e.counter;
+                });
+    }
+
+    auto check = [&](const Element &e, std::vector<long> &last) {
+        if(e.producer >= (unsigned long)Pushers || e.check != Element::Check(e.producer, e.counter) ||
+                (long)e.counter <= last[e.producer] || (!Overwrite && (long)e.counter != last[e.producer] + 1)) {
+            errors.fetch_add(1u, std::memory_order_relaxed);
+        }
+
+        last[e.producer] = (long)e.counter;
+    };
+
+    for(int i = 0; i < Subscribers; ++i) {
+        readers.emplace_back([&, i]() {
+                std::vector<long> last(Pushers, -1);
+                unsigned long long n = 0;
+                Element e;
+
+                for(;;) {
+                    // all pushes are done before pushers_done, drain and stop
+                    bool done = pushers_done.load(std::memory_order_acquire);
+
+                    if(ring->Pop(subscribers[i], &e)) {
+                        check(e, last);
+                        ++n;
+
+                        if(i == 0 && Overwrite && n % 64 == 0) {
+                            // fall behind a ring now and then
+                            std::this_thread::yield();
+                        }
+                    } else if(done) {
+                        break;
+                    }
+                }
+
+                popped[i] = n;
+                });
+    }
+
+    std::thread churn([&]() {
+            Element e;
+
+            while(!pushers_done.load(std::memory_order_acquire)) {
+                size_t subscriber;
+
+                if(!ring->Subscribe(&subscriber)) {
+                    errors.fetch_add(1u, std::memory_order_relaxed);
+                    break;
+                }
+
+                // joins mid-stream: order is checked from the first element seen
+                std::vector<long> last(Pushers, -1);
+                bool first[Pushers];
+
+                for(int j = 0; j < Pushers; ++j) {
+                    first[j] = true;
+                }
+
+                for(int j = 0; j < 1000 && !pushers_done.load(std::memory_order_relaxed); ) {
+                    if(!ring->Pop(subscriber, &e)) {
+                        continue;
+                    }
+
+                    if(e.producer < (unsigned long)Pushers && first[e.producer]) {
+                        first[e.producer] = false;
+                        last[e.producer] = (long)e.counter - 1;
+                    }
+
+                    check(e, last);
+                    ++j;
+                }
+
+                ring->Unsubscribe(subscriber);
+            }
+            });
+
+    for(size_t i = 0; i < pushers.size(); ++i) {
+        pushers[i].join();
+    }
+
+    pushers_done.store(1, std::memory_order_release);
+
+    for(size_t i = 0; i < readers.size(); ++i) {
+        readers[i].join();
+    }
+
+    churn.join();
+
+    unsigned long long total = 0;
+
+    for(int i = 0; i < Pushers; ++i) {
+        total += pushed[i];
+    }
+
+    bool ok = !errors.load();
+
+    printf("%s pushed=%llu, errors=%llu", name, total, errors.load());
+
+    for(int i = 0; i < Subscribers; ++i) {
+        unsigned long long overruns = ring->GetOverruns(subscribers[i]);
+
+        printf(", popped[%d]=%llu overruns[%d]=%llu", i, popped[i], i, overruns);
+
+        ok &= popped[i] + overruns == total;
+    }
+
+    printf("\n");
+
+    if(!ok) {
+        fprintf(stderr, "%s FAILED\n", name);
+        return 1;
+    }
+
+    return 0;
+}
+
+int main() {
+    signal(SIGINT, sig_handler);
+    signal(SIGTERM, sig_handler);
+
+    int block_ret = 0;
+
+    std::thread t([&block_ret]() {
+            block_ret = run<BroadcastRingDefaultOptions>("block_writer");
+            });
+
+    int overwrite_ret = run<BroadcastRingOverwriteOptions>("overwrite");
+    t.join();
+
+    return block_ret | overwrite_ret;
+}
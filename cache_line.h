@@ -0,0 +1,40 @@
+#ifndef __CACHE_LINE_H__
+#define __CACHE_LINE_H__
+
+#include <atomic>
+
+#include <stddef.h>
+
+// size used to keep independently written atomics apart.
+// std::hardware_destructive_interference_size is not stable across compilers, so we pin it.
+#ifndef CACHE_LINE_SIZE
+#define CACHE_LINE_SIZE 64
+#endif
+
+static constexpr size_t CacheLineSize = CACHE_LINE_SIZE;
+
+// small per-thread number used to pick a shard, slot or magazine, so threads that
+// run at the same time mostly land on different cache lines
+inline size_t ThreadOrdinal() {
+    static std::atomic<size_t> next_ordinal = ATOMIC_VAR_INIT(0);
+    thread_local size_t ordinal = next_ordinal.fetch_add(1u, std::memory_order_relaxed);
+
+    return ordinal;
+}
+
+static constexpr bool IsPowerOfTwo(size_t n) {
+    return n != 0 && (n & (n - 1u)) == 0;
+}
+
+// ring sizes rounded up, so pos is mapped to a slot by mask
+static constexpr size_t RoundUpPowerOfTwo(size_t n) {
+    size_t r = 1;
+
+    while(r < n) {
+        r <<= 1;
+    }
+
+    return r;
+}
+
+#endif
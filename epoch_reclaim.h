@@ -0,0 +1,227 @@
+#ifndef __EPOCH_RECLAIM_H__
+#define __EPOCH_RECLAIM_H__
+
+#include "cache_line.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <assert.h>
+#include <stdio.h>
+
+#define ASSERT_LOG(cond, fmt, ...) \
+    if(!(cond)) {\
+        fprintf(stderr, "[%s:%d:%s] " fmt "\n", __FILE__, __LINE__, __FUNCTION__, ##__VA_ARGS__);\
+        assert(0);\
+    }
+
+// epoch based reclamation: a thread pins the current epoch while it may touch shared
+// nodes, and an unlinked node is freed only after every thread pinned at the time of
+// Retire() has left. the global epoch moves on once all pinned threads have seen it,
+// so anything retired two epochs ago can no longer be referenced.
+
+struct EpochReclaimDefaultOptions {
+    // threads pinned at the same time, more threads wait for a free slot
+    static constexpr size_t Slots = 64;
+    // a slot tries to advance the epoch and free its old nodes every RetireBatch retires
+    static constexpr size_t RetireBatch = 64;
+};
+
+template<typename Options = EpochReclaimDefaultOptions>
+class EpochReclaim {
+    struct Slot;
+
+public:
+    // free_function(context, pointer) releases a retired pointer
+    using FreeFunction = void (*)(void *context, void *pointer);
+
+    // pinned while alive, see Pin()
+    class Guard {
+    public:
+        Guard(Guard &&other) : m_reclaim(other.m_reclaim), m_slot(other.m_slot) {
+            other.m_slot = nullptr;
+        }
+
+        ~Guard() {
+            if(m_slot) {
+                m_reclaim->Unpin(m_slot);
+            }
+        }
+
+    private:
+        friend class EpochReclaim;
+
+        Guard(EpochReclaim *reclaim, Slot *slot) : m_reclaim(reclaim), m_slot(slot) {}
+
+        Guard(const Guard &);
+        Guard &operator=(const Guard &);
+        Guard &operator=(Guard &&);
+
+        EpochReclaim *m_reclaim;
+        Slot *m_slot;
+    };
+
+    EpochReclaim() = default;
+
+    ~EpochReclaim() {
+        Drain();
+    }
+
+    // nodes read after Pin() stay valid until the guard goes away
+    Guard Pin() {
+        size_t ordinal = ThreadOrdinal();
+        Slot *slot;
+
+        for(size_t i = 0; ; ++i) {
+            slot = &m_slots[(ordinal + i) % Options::Slots];
+
+            if(!slot->busy.load(std::memory_order_relaxed) && !slot->busy.exchange(true, std::memory_order_acquire)) {
+                break;
+            }
+
+            if(i % Options::Slots == Options::Slots - 1u) {
+                // more pinned threads than slots
+                std::this_thread::yield();
+            }
+        }
+
+        // the pinned epoch must be visible before any shared node is read
+        uint64_t epoch = m_epoch.load(std::memory_order_relaxed);
+        for(;;) {
+            slot->epoch.store(epoch, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+
+            uint64_t current = m_epoch.load(std::memory_order_relaxed);
+
+            if(current == epoch) {
+                break;
+            }
+
+            epoch = current;
+        }
+
+        return Guard(this, slot);
+    }
+
+    // pointer is already unlinked, it is freed once no thread pinned now is left
+    void Retire(Guard &guard, void *pointer, FreeFunction free_function, void *context) {
+        Slot *slot = guard.m_slot;
+
+        ASSERT_LOG(slot, "guard is not pinned");
+
+        slot->retired.push_back(Retired{pointer, free_function, context, m_epoch.load(std::memory_order_acquire)});
+
+        if(++slot->retire_count % Options::RetireBatch == 0) {
+            TryAdvance();
+            Collect(slot);
+        }
+    }
+
+    // advance the epoch if possible and free what is safe in every idle slot.
+    // for quiet periods, when no Retire() runs to do it
+    void Collect() {
+        TryAdvance();
+
+        for(size_t i = 0; i < Options::Slots; ++i) {
+            Slot *slot = &m_slots[i];
+
+            if(!slot->busy.load(std::memory_order_relaxed) && !slot->busy.exchange(true, std::memory_order_acquire)) {
+                Collect(slot);
+                slot->busy.store(false, std::memory_order_release);
+            }
+        }
+    }
+
+    // free every retired pointer. no thread may be pinned. NOT thread safe
+    void Drain() {
+        for(size_t i = 0; i < Options::Slots; ++i) {
+            Slot *slot = &m_slots[i];
+
+            for(const Retired &retired : slot->retired) {
+                retired.free_function(retired.context, retired.pointer);
+            }
+
+            slot->retired.clear();
+        }
+    }
+
+    uint64_t GetEpoch() const {
+        return m_epoch.load(std::memory_order_relaxed);
+    }
+
+private:
+    struct Retired {
+        void *pointer;
+        FreeFunction free_function;
+        void *context;
+        uint64_t epoch;
+    };
+
+    // a thread owns a slot while busy is set, retired is only touched by the owner
+    struct alignas(CacheLineSize) Slot {
+        std::atomic<bool> busy = ATOMIC_VAR_INIT(false);
+        // pinned epoch, 0 while not pinned
+        std::atomic<uint64_t> epoch = ATOMIC_VAR_INIT(0);
+        size_t retire_count = 0;
+        std::vector<Retired> retired;
+    };
+
+    EpochReclaim(const EpochReclaim &);
+    EpochReclaim(EpochReclaim &&);
+    EpochReclaim &operator=(const EpochReclaim &);
+    EpochReclaim &operator=(EpochReclaim &&);
+
+    void Unpin(Slot *slot) {
+        slot->epoch.store(0, std::memory_order_release);
+
+        // a slot that stops retiring would keep its old nodes until someone collects
+        if(!slot->retired.empty() && slot->retired.front().epoch + 2u <= m_epoch.load(std::memory_order_relaxed)) {
+            Collect(slot);
+        }
+
+        slot->busy.store(false, std::memory_order_release);
+    }
+
+    // move on when every pinned thread has seen the current epoch
+    void TryAdvance() {
+        uint64_t epoch = m_epoch.load(std::memory_order_acquire);
+
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        for(size_t i = 0; i < Options::Slots; ++i) {
+            uint64_t pinned = m_slots[i].epoch.load(std::memory_order_acquire);
+
+            if(pinned && pinned != epoch) {
+                return;
+            }
+        }
+
+        m_epoch.compare_exchange_strong(epoch, epoch + 1u, std::memory_order_acq_rel);
+    }
+
+    // retired is in epoch order, free the prefix that is two epochs old
+    void Collect(Slot *slot) {
+        uint64_t epoch = m_epoch.load(std::memory_order_acquire);
+        size_t count = 0;
+
+        while(count < slot->retired.size() && slot->retired[count].epoch + 2u <= epoch) {
+            const Retired &retired = slot->retired[count];
+            retired.free_function(retired.context, retired.pointer);
+            ++count;
+        }
+
+        slot->retired.erase(slot->retired.begin(), slot->retired.begin() + count);
+    }
+
+    // 0 marks an unpinned slot, so epochs start at 1
+    alignas(CacheLineSize) std::atomic<uint64_t> m_epoch = ATOMIC_VAR_INIT(1);
+
+    Slot m_slots[Options::Slots];
+};
+
+#undef ASSERT_LOG
+
+#endif
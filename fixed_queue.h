@@ -1,8 +1,18 @@
 #ifndef __FIXED_QUEUE_H__
 #define __FIXED_QUEUE_H__
 
+#include "cache_line.h"
+#include "mapped_memory.h"
+#include "futex.h"
+#include "queue_stats.h"
+#include "backoff.h"
+
 #include <atomic>
 #include <thread>
+#include <type_traits>
+#include <iterator>
+#include <new>
+#include <chrono>
 
 #include <stddef.h>
 #include <assert.h>
@@ -19,67 +29,867 @@
     if(!(cond)) {}
 */
 
-template<typename ElementType, size_t Capacity>
+enum FIXED_QUEUE_SLOT_LAYOUT {
+    FIXED_QUEUE_SLOT_COMPACT = 0, // slots packed back to back
+    FIXED_QUEUE_SLOT_PADDED, // every slot starts on its own cache line
+    FIXED_QUEUE_SLOT_INTERLEAVED, // slots packed, but neighbouring positions land on different cache lines
+};
+
+enum FIXED_QUEUE_SLOT_PROTOCOL {
+    // CAS cursor, then CAS the slot through RWREF_STATUS. the slot state does not know its
+    // lap, so with several writers and readers a writer of the next lap may fill a slot
+    // before a stalled writer of this lap: nothing is lost, but per-producer order is not kept
+    FIXED_QUEUE_PROTOCOL_RWREF = 0,
+    FIXED_QUEUE_PROTOCOL_SEQUENCE, // per-slot sequence number, slot is claimed only when it is ready
+    // fetch_add claims a pos, no cursor CAS. the slot's turn {pos, phase} tells whose the
+    // slot is, a pos whose writer finds the queue full or whose reader finds it empty is
+    // skipped, see BeginPushTicket()
+    FIXED_QUEUE_PROTOCOL_TICKET,
+};
+
+struct FixedQueueDefaultOptions {
+    // false when only one thread ever calls Push (resp. Pop): that side's cursor
+    // is advanced by plain store instead of CAS
+    static constexpr bool MultiWriter = true;
+    static constexpr bool MultiReader = true;
+    static constexpr int SlotProtocol = FIXED_QUEUE_PROTOCOL_RWREF;
+    // put m_read and m_write on their own cache lines
+    static constexpr bool PadCursors = false;
+    static constexpr int SlotLayout = FIXED_QUEUE_SLOT_COMPACT;
+    // allocate next power of two slots for a non power of two Capacity, so pos is
+    // mapped to a slot by mask. usable capacity is still exactly Capacity
+    static constexpr bool RoundUpCapacity = false;
+    // enable PushWait()/PopWait(). successful Push/Pop then check for sleeping
+    // waiters of the other side (a fence and a load, no syscall when nobody sleeps)
+    static constexpr bool Blocking = false;
+    // Push/Pop attempts before a waiter goes to sleep
+    static constexpr unsigned BlockingSpinCount = 64;
+    // QueueStats<> counts operations, full/empty returns, lost cursor CAS and slot
+    // waits, see GetStats()
+    using Stats = QueueNoStats;
+    // what cursor CAS retries and slot waits do after a miss, see backoff.h
+    using Backoff = BackoffDefault;
+};
+
+struct FixedQueuePaddedOptions : FixedQueueDefaultOptions {
+    static constexpr bool PadCursors = true;
+    static constexpr int SlotLayout = FIXED_QUEUE_SLOT_PADDED;
+};
+
+struct FixedQueueInterleavedOptions : FixedQueueDefaultOptions {
+    static constexpr bool PadCursors = true;
+    static constexpr int SlotLayout = FIXED_QUEUE_SLOT_INTERLEAVED;
+};
+
+struct FixedQueueSequenceOptions : FixedQueueDefaultOptions {
+    static constexpr int SlotProtocol = FIXED_QUEUE_PROTOCOL_SEQUENCE;
+};
+
+// every thread hits both cursors with fetch_add, keep them apart
+struct FixedQueueTicketOptions : FixedQueueDefaultOptions {
+    static constexpr int SlotProtocol = FIXED_QUEUE_PROTOCOL_TICKET;
+    static constexpr bool PadCursors = true;
+};
+
+// single producer, single consumer: wait-free ring of two cursors, slot state is not used
+struct FixedQueueSpscOptions : FixedQueuePaddedOptions {
+    static constexpr bool MultiWriter = false;
+    static constexpr bool MultiReader = false;
+};
+
+struct FixedQueueMpscOptions : FixedQueueSequenceOptions {
+    static constexpr bool PadCursors = true;
+    static constexpr bool MultiReader = false;
+};
+
+struct FixedQueueSpmcOptions : FixedQueueSequenceOptions {
+    static constexpr bool PadCursors = true;
+    static constexpr bool MultiWriter = false;
+};
+
+struct FixedQueueStatsOptions : FixedQueueDefaultOptions {
+    using Stats = QueueStats<>;
+};
+
+// Capacity of a FixedQueue whose capacity is given to its constructor,
+// its slots are mmap-ed instead of embedded in the object
+static constexpr size_t FixedQueueDynamicCapacity = 0;
+
+template<typename ElementType, size_t Capacity, typename Options = FixedQueueDefaultOptions>
 class FixedQueue {
 public:
 
     FixedQueue() {
-        static_assert(Capacity != 0);
+        static_assert(Capacity != FixedQueueDynamicCapacity, "capacity is given at runtime, use FixedQueue(capacity)");
+
+        InitSlots();
+    }
+
+    // FixedQueueDynamicCapacity only. throw std::bad_alloc if slots can not be mapped
+    explicit FixedQueue(size_t capacity, const MappedMemoryOptions &memory_options = MappedMemoryOptions()) {
+        static_assert(Capacity == FixedQueueDynamicCapacity, "capacity is fixed at compile time, use FixedQueue()");
+        assert(capacity != 0);
+
+        m_capacity = capacity;
+        m_ring_size = Options::RoundUpCapacity ? RoundUpPowerOfTwo(capacity) : capacity;
+        m_ring_mask = IsPowerOfTwo(m_ring_size) ? m_ring_size - 1u : 0;
+        m_interleaved_lines = m_ring_size / SlotsPerLine;
+
+        void *p = MappedMemoryAllocate(m_ring_size * sizeof(ElementNode), memory_options, &m_mapped_bytes);
+
+        if(!p) {
+            throw std::bad_alloc();
+        }
+
+        m_element_nodes = (ElementNode *)p;
+
+        for(size_t i = 0; i < m_ring_size; ++i) {
+            new (&m_element_nodes[i]) ElementNode();
+        }
+
+        InitSlots();
     }
 
     ~FixedQueue() {
         Clear();
+
+        if constexpr (IsDynamic) {
+            // ElementNode is trivially destructible
+            MappedMemoryFree(m_element_nodes, m_mapped_bytes);
+        }
     }
 
     template<typename ... Args>
     bool Push(Args && ... args) {
+        size_t write;
+        ElementNode *elem_node = BeginPush(&write);
+
+        if(!elem_node) {
+            // queue is full
+            m_stats.Add(QUEUE_STAT_FULL);
+            return false;
+        }
+
+        ConstructElementAt(elem_node, std::forward<Args>(args) ...);
+
+        EndPush(elem_node, write);
+
+        NotifyPushed(1u);
+        m_stats.Add(QUEUE_STAT_PUSH);
+
+        return true;
+    }
+
+    template<typename OutType>
+    bool Pop(OutType *out) {
+        size_t read;
+        ElementNode *elem_node = BeginPop(&read);
+
+        if(!elem_node) {
+            // queue is empty
+            m_stats.Add(QUEUE_STAT_EMPTY);
+            return false;
+        }
+
+        if(out) {
+            *out = std::move(*AccessElementAt(elem_node));
+        }
+
+        DestructElementAt(elem_node);
+
+        EndPop(elem_node, read);
+
+        NotifyPopped(1u);
+        m_stats.Add(QUEUE_STAT_POP);
+
+        return true;
+    }
+
+    // f(ElementType &elem) works on the element in its slot, no output temporary.
+    // the element is destructed after f returns
+    template<typename Function>
+    bool ConsumeInPlace(Function f) {
         size_t read;
+        ElementNode *elem_node = BeginPop(&read);
+
+        if(!elem_node) {
+            // queue is empty
+            m_stats.Add(QUEUE_STAT_EMPTY);
+            return false;
+        }
+
+        f(*AccessElementAt(elem_node));
+
+        DestructElementAt(elem_node);
+
+        EndPop(elem_node, read);
+
+        NotifyPopped(1u);
+        m_stats.Add(QUEUE_STAT_POP);
+
+        return true;
+    }
+
+    // push elements of [first, last) into consecutive positions reserved at once.
+    // return how many elements (from first) were pushed, fewer than requested if queue is nearly full
+    template<typename Iterator>
+    size_t PushN(Iterator first, Iterator last) {
+        size_t n = (size_t)std::distance(first, last);
         size_t write;
+        size_t count;
+
+        if constexpr (IsTicketProtocol && !IsSpsc) {
+            // a reader may skip any pos, so pos are claimed one by one
+            for(count = 0; count < n; ++count, ++first) {
+                ElementNode *elem_node = BeginPushTicket(&write);
+
+                if(!elem_node) {
+                    break;
+                }
+
+                ConstructElementAt(elem_node, *first);
+
+                EndPush(elem_node, write);
+            }
+        } else {
+            count = n ? ReserveWrite(n, &write) : 0;
+
+            for(size_t i = 0; i < count; ++i, ++first) {
+                ElementNode *elem_node = AcquireWriteSlot(write + i);
+
+                ConstructElementAt(elem_node, *first);
+
+                EndPush(elem_node, write + i);
+            }
+        }
+
+        if(count) {
+            NotifyPushed(count);
+            m_stats.Add(QUEUE_STAT_PUSH, count);
+        } else {
+            m_stats.Add(QUEUE_STAT_FULL);
+        }
+
+        return count;
+    }
+
+    // pop at most max elements from consecutive positions reserved at once into out.
+    // return how many elements were popped
+    template<typename OutIterator>
+    size_t PopN(OutIterator out, size_t max) {
+        size_t read;
+        size_t count;
+
+        if constexpr (IsTicketProtocol && !IsSpsc) {
+            // a writer may give up any pos, so pos are claimed one by one
+            for(count = 0; count < max; ++count) {
+                ElementNode *elem_node = BeginPopTicket(&read);
+
+                if(!elem_node) {
+                    break;
+                }
+
+                *out = std::move(*AccessElementAt(elem_node));
+                ++out;
+
+                DestructElementAt(elem_node);
+
+                EndPop(elem_node, read);
+            }
+        } else {
+            count = max ? ReserveRead(max, &read) : 0;
+
+            for(size_t i = 0; i < count; ++i) {
+                ElementNode *elem_node = AcquireReadSlot(read + i);
+
+                *out = std::move(*AccessElementAt(elem_node));
+                ++out;
+
+                DestructElementAt(elem_node);
+
+                EndPop(elem_node, read + i);
+            }
+        }
+
+        if(count) {
+            NotifyPopped(count);
+            m_stats.Add(QUEUE_STAT_POP, count);
+        } else {
+            m_stats.Add(QUEUE_STAT_EMPTY);
+        }
+
+        return count;
+    }
+
+    // Options::Blocking only. push, sleep while queue is full
+    template<typename ... Args>
+    void PushWait(Args && ... args) {
+        WaitFor(m_blocking.not_full_epoch, m_blocking.push_waiters, nullptr, [&]() {
+                    return Push(std::forward<Args>(args) ...);
+                });
+    }
+
+    // Options::Blocking only. like PushWait(), return false if not pushed in timeout
+    template<typename Rep, typename Period, typename ... Args>
+    bool PushWaitFor(const std::chrono::duration<Rep, Period> &timeout, Args && ... args) {
+        std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + timeout;
+
+        return WaitFor(m_blocking.not_full_epoch, m_blocking.push_waiters, &deadline, [&]() {
+                    return Push(std::forward<Args>(args) ...);
+                });
+    }
+
+    // Options::Blocking only. pop, sleep while queue is empty
+    template<typename OutType>
+    void PopWait(OutType *out) {
+        WaitFor(m_blocking.not_empty_epoch, m_blocking.pop_waiters, nullptr, [&]() {
+                    return Pop(out);
+                });
+    }
+
+    // Options::Blocking only. like PopWait(), return false if nothing popped in timeout
+    template<typename OutType, typename Rep, typename Period>
+    bool PopWaitFor(OutType *out, const std::chrono::duration<Rep, Period> &timeout) {
+        std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + timeout;
+
+        return WaitFor(m_blocking.not_empty_epoch, m_blocking.pop_waiters, &deadline, [&]() {
+                    return Pop(out);
+                });
+    }
+
+    void Clear() {
+        while(Pop<ElementType>(nullptr));
+    }
+
+    size_t GetCapacity() const {
+        return QueueCapacity();
+    }
+
+    size_t ApproximateSize() const {
+        ptrdiff_t size = (ptrdiff_t)(m_write.load(std::memory_order_relaxed) -
+            m_read.load(std::memory_order_relaxed));
+
+        // FIXED_QUEUE_PROTOCOL_TICKET: readers skipping pos may run ahead of m_write,
+        // and pos given up by writers count until they are skipped
+        if(size < 0) {
+            return 0;
+        }
+
+        return (size_t)size < QueueCapacity() ? (size_t)size : QueueCapacity();
+    }
+
+    // all zero unless Options::Stats counts
+    QueueStatsSnapshot GetStats() const {
+        return m_stats.Snapshot();
+    }
+
+private:
+    FixedQueue(const FixedQueue &);
+    FixedQueue(FixedQueue &&);
+    FixedQueue &operator=(const FixedQueue &);
+    FixedQueue &operator=(FixedQueue &&);
+
+    static constexpr size_t ElementTypeSize = sizeof(ElementType);
+
+    static constexpr bool IsSequenceProtocol = Options::SlotProtocol == FIXED_QUEUE_PROTOCOL_SEQUENCE;
+    static constexpr bool IsTicketProtocol = Options::SlotProtocol == FIXED_QUEUE_PROTOCOL_TICKET;
+    static constexpr bool IsSpsc = !Options::MultiWriter && !Options::MultiReader;
+
+    using SlotStateType = typename std::conditional<IsSequenceProtocol || IsTicketProtocol, size_t, int>::type;
+
+    static constexpr size_t MaxAlign(size_t a, size_t b) {
+        return a > b ? a : b;
+    }
+
+    static constexpr size_t ElementNodeAlign = Options::SlotLayout == FIXED_QUEUE_SLOT_PADDED ?
+        MaxAlign(CacheLineSize, alignof(ElementType)) : MaxAlign(alignof(std::atomic<SlotStateType>), alignof(ElementType));
+
+    static constexpr size_t ArrayAlign = Options::SlotLayout == FIXED_QUEUE_SLOT_COMPACT ?
+        ElementNodeAlign : MaxAlign(CacheLineSize, ElementNodeAlign);
+
+    static constexpr size_t CursorAlign = Options::PadCursors ?
+        CacheLineSize : alignof(std::atomic<size_t>);
+
+    struct alignas(ElementNodeAlign) ElementNode {
+        alignas(alignof(ElementType)) char buffer[ElementTypeSize];
+        // FIXED_QUEUE_PROTOCOL_RWREF: one of RWREF_STATUS
+        // FIXED_QUEUE_PROTOCOL_SEQUENCE: pos when writable for pos, pos+1 when readable for pos
+        // FIXED_QUEUE_PROTOCOL_TICKET: TicketTurn(pos, one of TICKET_PHASE)
+        std::atomic<SlotStateType> state = ATOMIC_VAR_INIT(0);
+    };
+
+    // move a cursor from expected to desired. with a single thread on that side
+    // nobody else can move it, so a plain store is enough
+    template<bool Multi>
+    static bool TakeCursor(std::atomic<size_t> &cursor, size_t &expected, size_t desired) {
+        if constexpr (Multi) {
+            return cursor.compare_exchange_strong(expected, desired, std::memory_order_relaxed);
+        } else {
+            cursor.store(desired, std::memory_order_relaxed);
+            return true;
+        }
+    }
+
+    // SPSC: m_write is only moved by EndPush, m_cached_read is writer private
+    size_t ReserveWriteSpsc(size_t n, size_t *pos) {
+        size_t write = m_write.load(std::memory_order_relaxed);
+        size_t count = QueueCapacity() - (write - m_cached_read);
+
+        if(count < n) {
+            m_cached_read = m_read.load(std::memory_order_acquire);
+            count = QueueCapacity() - (write - m_cached_read);
+        }
+
+        if(count > n) {
+            count = n;
+        }
+
+        *pos = write;
+        return count;
+    }
+
+    // SPSC: m_read is only moved by EndPop, m_cached_write is reader private
+    size_t ReserveReadSpsc(size_t n, size_t *pos) {
+        size_t read = m_read.load(std::memory_order_relaxed);
+        size_t count = m_cached_write - read;
+
+        if(count < n) {
+            m_cached_write = m_write.load(std::memory_order_acquire);
+            count = m_cached_write - read;
+        }
+
+        if(count > n) {
+            count = n;
+        }
+
+        *pos = read;
+        return count;
+    }
+
+    // claim the slot for the next write pos, nullptr if queue is full
+    ElementNode *BeginPush(size_t *pos) {
+        if constexpr (IsTicketProtocol && !IsSpsc) {
+            return BeginPushTicket(pos);
+        } else if constexpr (IsSequenceProtocol && !IsSpsc) {
+            return BeginPushSequence(pos);
+        } else {
+            if(!ReserveWrite(1u, pos)) {
+                return nullptr;
+            }
+
+            return AcquireWriteSlot(*pos);
+        }
+    }
+
+    ElementNode *BeginPushSequence(size_t *pos) {
+        size_t write = m_write.load(std::memory_order_relaxed);
         ElementNode *elem_node;
+        typename Options::Backoff backoff;
+
+        for(;;) {
+            elem_node = &m_element_nodes[ArrayIndex(write)];
+            size_t seq = elem_node->state.load(std::memory_order_acquire);
+            ptrdiff_t diff = (ptrdiff_t)(seq - write);
+
+            if(diff == 0) {
+                if(QueueRingSize() != QueueCapacity() && write - m_read.load(std::memory_order_relaxed) >= QueueCapacity()) {
+                    // slot is free, but Capacity elements are in queue already
+                    return nullptr;
+                }
+
+                if(TakeCursor<Options::MultiWriter>(m_write, write, write + 1u)) {
+                    // take pos success, slot is ours
+                    break;
+                }
+
+                m_stats.Add(QUEUE_STAT_WRITE_CAS_FAILURE);
+                backoff.Retry();
+            } else if(diff < 0) {
+                // slot still holds the element of last round: queue is full
+                return nullptr;
+            } else {
+                // another writer took this pos
+                backoff.Retry();
+                write = m_write.load(std::memory_order_relaxed);
+            }
+        }
+
+        *pos = write;
+        return elem_node;
+    }
+
+    // one fetch_add per attempt, whatever the number of writers. a pos is never handed
+    // back: a writer finding the queue full leaves its pos to be skipped by the reader of
+    // that pos, a writer whose pos was skipped takes a new one
+    ElementNode *BeginPushTicket(size_t *pos) {
+        typename Options::Backoff backoff;
+
+        for(;;) {
+            // m_write first: m_read read after it is never behind, so a full queue is never reported too early
+            size_t write = m_write.load(std::memory_order_relaxed);
+            size_t read = m_read.load(std::memory_order_relaxed);
+
+            if((ptrdiff_t)(write - read) >= (ptrdiff_t)QueueCapacity()) {
+                // queue is full, do not take a pos only to give it up
+                return nullptr;
+            }
+
+            write = m_write.fetch_add(1u, std::memory_order_relaxed);
+
+            if(QueueRingSize() != QueueCapacity() && write - m_read.load(std::memory_order_relaxed) >= QueueCapacity()) {
+                // other writers passed the check above at the same time: the slot may be
+                // free, but Capacity elements are in queue already. the reader of this pos
+                // will skip it
+                return nullptr;
+            }
+
+            ElementNode *elem_node = &m_element_nodes[ArrayIndex(write)];
+            size_t turn = TicketTurn(write, TICKET_WRITABLE);
+
+            for(;;) {
+                size_t state = elem_node->state.load(std::memory_order_acquire);
+
+                if(state == turn) {
+                    // the reader of this pos may skip it at the same time
+                    if(elem_node->state.compare_exchange_strong(state, TicketTurn(write, TICKET_WRITING), std::memory_order_acquire)) {
+                        *pos = write;
+                        return elem_node;
+                    }
+                } else if((ptrdiff_t)(state - turn) > 0) {
+                    // the reader of this pos has skipped it, take a new pos
+                    m_stats.Add(QUEUE_STAT_WRITE_CAS_FAILURE);
+                    backoff.Retry();
+                    break;
+                } else if((ptrdiff_t)(write - m_read.load(std::memory_order_relaxed)) >= (ptrdiff_t)QueueRingSize()) {
+                    // slot holds the element of last round and no reader has taken it yet:
+                    // queue is full. the reader of this pos will skip it
+                    return nullptr;
+                } else {
+                    // the reader of last round is on the slot
+                    m_stats.Add(QUEUE_STAT_SLOT_YIELD);
+                    backoff.Wait();
+                }
+            }
+        }
+    }
+
+    // reserve at most n write pos starting from *pos, return how many were reserved
+    size_t ReserveWrite(size_t n, size_t *pos) {
+        if constexpr (IsSpsc) {
+            return ReserveWriteSpsc(n, pos);
+        } else if constexpr (IsSequenceProtocol) {
+            return ReserveWriteSequence(n, pos);
+        } else {
+            return ReserveWriteRwref(n, pos);
+        }
+    }
+
+    size_t ReserveWriteSequence(size_t n, size_t *pos) {
+        size_t read;
+        size_t write = m_write.load(std::memory_order_relaxed);
+        size_t count;
+        typename Options::Backoff backoff;
+
+        for(;;) {
+            size_t seq = m_element_nodes[ArrayIndex(write)].state.load(std::memory_order_acquire);
+            ptrdiff_t diff = (ptrdiff_t)(seq - write);
+
+            if(diff < 0) {
+                // queue is full
+                return 0;
+            }
+
+            if(diff > 0) {
+                // another writer took this pos
+                backoff.Retry();
+                write = m_write.load(std::memory_order_relaxed);
+                continue;
+            }
+
+            // first slot is free, so m_read has passed its last round
+            read = m_read.load(std::memory_order_relaxed);
+
+            ASSERT_LOG(read + QueueRingSize() > write, "read=%lu, write=%lu, write-read=%lu",
+                    read, write, write-read);
+
+            if(QueueRingSize() != QueueCapacity() && write - read >= QueueCapacity()) {
+                // queue is full
+                return 0;
+            }
+
+            count = QueueCapacity() - (write - read);
+
+            if(count > n) {
+                count = n;
+            }
+
+            if(TakeCursor<Options::MultiWriter>(m_write, write, write + count)) {
+                break;
+            }
+
+            m_stats.Add(QUEUE_STAT_WRITE_CAS_FAILURE);
+            backoff.Retry();
+        }
+
+        *pos = write;
+        return count;
+    }
+
+    size_t ReserveWriteRwref(size_t n, size_t *pos) {
+        size_t read;
+        size_t write;
+        size_t count;
+        typename Options::Backoff backoff;
 
         write = m_write.load(std::memory_order_relaxed);
 RETRY:
         read = m_read.load(std::memory_order_relaxed);
 
-        if(read + Capacity == write) {
+        if(read + QueueCapacity() == write) {
             // queue is full
-            return false;
+            return 0;
+        }
+
+        count = QueueCapacity() - (write - read);
+
+        if(count > n) {
+            count = n;
         }
 
-        if(!m_write.compare_exchange_strong(write, write + 1u, std::memory_order_relaxed)) {
+        if(!TakeCursor<Options::MultiWriter>(m_write, write, write + count)) {
             // take pos failed
+            m_stats.Add(QUEUE_STAT_WRITE_CAS_FAILURE);
+            backoff.Retry();
             goto RETRY;
         }
 
         ASSERT_LOG(read <= write, "read=%lu, write=%lu", read, write);
-        ASSERT_LOG(read + Capacity > write, "read=%lu, write=%lu, write-read=%lu",
+        ASSERT_LOG(read + QueueCapacity() > write, "read=%lu, write=%lu, write-read=%lu",
                 read, write, write-read);
 
         // take pos success
-        elem_node = &m_element_nodes[ArrayIndex(write)];
+        *pos = write;
+        return count;
+    }
 
-        // start write (lock elem_node)
-        for(int expected = RWREF_EMPTY; !elem_node->rwref.compare_exchange_strong(expected, RWREF_WRITING, std::memory_order_acquire); expected = RWREF_EMPTY) {
-            std::this_thread::yield();
+    // wait until the slot of a reserved write pos can be written
+    ElementNode *AcquireWriteSlot(size_t write) {
+        ElementNode *elem_node = &m_element_nodes[ArrayIndex(write)];
+        typename Options::Backoff backoff;
+
+        if constexpr (IsSpsc) {
+            // m_read has passed it, nothing else to wait for
+        } else if constexpr (IsSequenceProtocol) {
+            // reader of last round has taken the pos, but may not finish reading yet
+            while(elem_node->state.load(std::memory_order_acquire) != write) {
+                m_stats.Add(QUEUE_STAT_SLOT_YIELD);
+                backoff.Wait();
+            }
+        } else if constexpr (!Options::MultiWriter) {
+            // only this writer waits for the slot: no need to lock it
+            while(elem_node->state.load(std::memory_order_acquire) != RWREF_EMPTY) {
+                m_stats.Add(QUEUE_STAT_SLOT_YIELD);
+                backoff.Wait();
+            }
+        } else {
+            // start write (lock elem_node)
+            for(int expected = RWREF_EMPTY; !elem_node->state.compare_exchange_strong(expected, RWREF_WRITING, std::memory_order_acquire); expected = RWREF_EMPTY) {
+                m_stats.Add(QUEUE_STAT_SLOT_YIELD);
+                backoff.Wait();
+            }
         }
 
-        ConstructElementAt(elem_node, std::forward<Args>(args) ...);
+        return elem_node;
+    }
 
-        // finish write (unlock elem_node)
-        {
+    void EndPush(ElementNode *elem_node, size_t write) {
+        if constexpr (IsSpsc) {
+            m_write.store(write + 1u, std::memory_order_release);
+        } else if constexpr (IsTicketProtocol) {
+            elem_node->state.store(TicketTurn(write, TICKET_READABLE), std::memory_order_release);
+        } else if constexpr (IsSequenceProtocol) {
+            elem_node->state.store(write + 1u, std::memory_order_release);
+        } else if constexpr (!Options::MultiWriter) {
+            elem_node->state.store(RWREF_WRITTEN, std::memory_order_release);
+        } else {
+            // finish write (unlock elem_node)
             int expected = RWREF_WRITING;
-            bool ok = elem_node->rwref.compare_exchange_strong(expected, RWREF_WRITTEN, std::memory_order_release);
-            ASSERT_LOG(ok, "read=%lu, write=%lu, old=%d", read, write, expected);
+            bool ok = elem_node->state.compare_exchange_strong(expected, RWREF_WRITTEN, std::memory_order_release);
+            ASSERT_LOG(ok, "write=%lu, old=%d", write, expected);
         }
+    }
 
-        return true;
+    // claim the slot for the next read pos, nullptr if queue is empty
+    ElementNode *BeginPop(size_t *pos) {
+        if constexpr (IsTicketProtocol && !IsSpsc) {
+            return BeginPopTicket(pos);
+        } else if constexpr (IsSequenceProtocol && !IsSpsc) {
+            return BeginPopSequence(pos);
+        } else {
+            if(!ReserveRead(1u, pos)) {
+                return nullptr;
+            }
+
+            return AcquireReadSlot(*pos);
+        }
     }
 
-    template<typename OutType>
-    bool Pop(OutType *out) {
+    ElementNode *BeginPopSequence(size_t *pos) {
+        size_t read = m_read.load(std::memory_order_relaxed);
+        ElementNode *elem_node;
+        typename Options::Backoff backoff;
+
+        for(;;) {
+            elem_node = &m_element_nodes[ArrayIndex(read)];
+            size_t seq = elem_node->state.load(std::memory_order_acquire);
+            ptrdiff_t diff = (ptrdiff_t)(seq - (read + 1u));
+
+            if(diff == 0) {
+                if(TakeCursor<Options::MultiReader>(m_read, read, read + 1u)) {
+                    // take pos success, slot is ours
+                    break;
+                }
+
+                m_stats.Add(QUEUE_STAT_READ_CAS_FAILURE);
+                backoff.Retry();
+            } else if(diff < 0) {
+                // slot is not written yet (or its writer is still running): queue is empty
+                return nullptr;
+            } else {
+                // another reader took this pos
+                backoff.Retry();
+                read = m_read.load(std::memory_order_relaxed);
+            }
+        }
+
+        *pos = read;
+        return elem_node;
+    }
+
+    // see BeginPushTicket(). a reader finding no writer on its pos skips the pos, so the
+    // writer takes a new one, and reports empty queue if no writer is behind it
+    ElementNode *BeginPopTicket(size_t *pos) {
+        typename Options::Backoff backoff;
+
+        for(;;) {
+            // m_read first: m_write read after it is never behind, so an empty queue is never reported too early
+            size_t read = m_read.load(std::memory_order_relaxed);
+            size_t write = m_write.load(std::memory_order_relaxed);
+
+            if((ptrdiff_t)(write - read) <= 0) {
+                // queue is empty, do not take a pos only to skip it
+                return nullptr;
+            }
+
+            read = m_read.fetch_add(1u, std::memory_order_relaxed);
+
+            ElementNode *elem_node = &m_element_nodes[ArrayIndex(read)];
+            size_t turn = TicketTurn(read, TICKET_READABLE);
+
+            for(;;) {
+                size_t state = elem_node->state.load(std::memory_order_acquire);
+
+                if(state == turn) {
+                    // nobody else waits for this turn
+                    *pos = read;
+                    return elem_node;
+                }
+
+                if(state == TicketTurn(read, TICKET_WRITABLE)) {
+                    // the writer of this pos has not come yet, or has given it up
+                    if(!elem_node->state.compare_exchange_strong(state, TicketTurn(read + QueueRingSize(), TICKET_WRITABLE), std::memory_order_acq_rel)) {
+                        // the writer has just come
+                        continue;
+                    }
+
+                    m_stats.Add(QUEUE_STAT_READ_CAS_FAILURE);
+
+                    if((ptrdiff_t)(m_write.load(std::memory_order_relaxed) - (read + 1u)) <= 0) {
+                        // no writer behind this pos: queue is empty
+                        CatchUpWrite(read + 1u);
+                        return nullptr;
+                    }
+
+                    backoff.Retry();
+                    break;
+                }
+
+                // the writer of this pos is writing, or the slot is still in last round
+                m_stats.Add(QUEUE_STAT_SLOT_YIELD);
+                backoff.Wait();
+            }
+        }
+    }
+
+    // skipping readers may have taken m_read past m_write. pos up to read are all
+    // taken by readers and will be skipped, move m_write there so writers do not
+    // take them only to be skipped
+    void CatchUpWrite(size_t read) {
+        size_t write = m_write.load(std::memory_order_relaxed);
+
+        while((ptrdiff_t)(read - write) > 0 && !m_write.compare_exchange_weak(write, read, std::memory_order_relaxed));
+    }
+
+    // reserve at most n read pos starting from *pos, return how many were reserved
+    size_t ReserveRead(size_t n, size_t *pos) {
+        if constexpr (IsSpsc) {
+            return ReserveReadSpsc(n, pos);
+        } else if constexpr (IsSequenceProtocol) {
+            return ReserveReadSequence(n, pos);
+        } else {
+            return ReserveReadRwref(n, pos);
+        }
+    }
+
+    size_t ReserveReadSequence(size_t n, size_t *pos) {
+        size_t read = m_read.load(std::memory_order_relaxed);
+        size_t write;
+        size_t count;
+        typename Options::Backoff backoff;
+
+        for(;;) {
+            size_t seq = m_element_nodes[ArrayIndex(read)].state.load(std::memory_order_acquire);
+            ptrdiff_t diff = (ptrdiff_t)(seq - (read + 1u));
+
+            if(diff < 0) {
+                // queue is empty
+                return 0;
+            }
+
+            if(diff > 0) {
+                // another reader took this pos
+                backoff.Retry();
+                read = m_read.load(std::memory_order_relaxed);
+                continue;
+            }
+
+            // first slot is written, so m_write has passed it
+            write = m_write.load(std::memory_order_relaxed);
+            count = write - read;
+
+            ASSERT_LOG(read < write, "read=%lu, write=%lu", read, write);
+
+            if(count > n) {
+                count = n;
+            }
+
+            if(TakeCursor<Options::MultiReader>(m_read, read, read + count)) {
+                break;
+            }
+
+            m_stats.Add(QUEUE_STAT_READ_CAS_FAILURE);
+            backoff.Retry();
+        }
+
+        *pos = read;
+        return count;
+    }
+
+    size_t ReserveReadRwref(size_t n, size_t *pos) {
         size_t read;
         size_t write;
-        ElementNode *elem_node;
+        size_t count;
+        typename Options::Backoff backoff;
 
         read = m_read.load(std::memory_order_relaxed);
 RETRY:
@@ -87,63 +897,161 @@ RETRY:
 
         if(read == write) {
             // queue is empty
-            return false;
+            return 0;
         }
 
-        if(!m_read.compare_exchange_strong(read, read + 1u, std::memory_order_relaxed)) {
+        count = write - read;
+
+        if(count > n) {
+            count = n;
+        }
+
+        if(!TakeCursor<Options::MultiReader>(m_read, read, read + count)) {
             // take pos failed
+            m_stats.Add(QUEUE_STAT_READ_CAS_FAILURE);
+            backoff.Retry();
             goto RETRY;
         }
 
         ASSERT_LOG(read < write, "read=%lu, write=%lu", read, write);
-        ASSERT_LOG(read + Capacity >= write, "read=%lu, write=%lu, write-read=%lu",
+        ASSERT_LOG(read + QueueCapacity() >= write, "read=%lu, write=%lu, write-read=%lu",
                 read, write, write-read);
 
         // take pos success
-        elem_node = &m_element_nodes[ArrayIndex(read)];
+        *pos = read;
+        return count;
+    }
 
-        // start read
-        for(int expected = RWREF_WRITTEN; !elem_node->rwref.compare_exchange_strong(expected, RWREF_READING, std::memory_order_acquire); expected = RWREF_WRITTEN) {
-            std::this_thread::yield();
-        }
+    // wait until the slot of a reserved read pos has been written
+    ElementNode *AcquireReadSlot(size_t read) {
+        ElementNode *elem_node = &m_element_nodes[ArrayIndex(read)];
+        typename Options::Backoff backoff;
 
-        if(out) {
-            *out = std::move(*AccessElementAt(elem_node));
+        if constexpr (IsSpsc) {
+            // m_write has passed it, nothing else to wait for
+        } else if constexpr (IsSequenceProtocol) {
+            // writer has taken the pos, but may not finish writing yet
+            while(elem_node->state.load(std::memory_order_acquire) != read + 1u) {
+                m_stats.Add(QUEUE_STAT_SLOT_YIELD);
+                backoff.Wait();
+            }
+        } else if constexpr (!Options::MultiReader) {
+            // only this reader waits for the slot: no need to lock it
+            while(elem_node->state.load(std::memory_order_acquire) != RWREF_WRITTEN) {
+                m_stats.Add(QUEUE_STAT_SLOT_YIELD);
+                backoff.Wait();
+            }
+        } else {
+            // start read
+            for(int expected = RWREF_WRITTEN; !elem_node->state.compare_exchange_strong(expected, RWREF_READING, std::memory_order_acquire); expected = RWREF_WRITTEN) {
+                m_stats.Add(QUEUE_STAT_SLOT_YIELD);
+                backoff.Wait();
+            }
         }
 
-        DestructElementAt(elem_node);
+        return elem_node;
+    }
 
-        // finish read
-        {
+    void EndPop(ElementNode *elem_node, size_t read) {
+        if constexpr (IsSpsc) {
+            m_read.store(read + 1u, std::memory_order_release);
+        } else if constexpr (IsTicketProtocol) {
+            // writable for the same slot in next round
+            elem_node->state.store(TicketTurn(read + QueueRingSize(), TICKET_WRITABLE), std::memory_order_release);
+        } else if constexpr (IsSequenceProtocol) {
+            // writable again for the same slot in next round
+            elem_node->state.store(read + QueueRingSize(), std::memory_order_release);
+        } else if constexpr (!Options::MultiReader) {
+            elem_node->state.store(RWREF_EMPTY, std::memory_order_release);
+        } else {
+            // finish read
             int expected = RWREF_READING;
-            bool ok = elem_node->rwref.compare_exchange_strong(expected, RWREF_EMPTY, std::memory_order_release);
-            ASSERT_LOG(ok, "read=%lu, write=%lu, old=%d", read, write, expected);
+            bool ok = elem_node->state.compare_exchange_strong(expected, RWREF_EMPTY, std::memory_order_release);
+            ASSERT_LOG(ok, "read=%lu, old=%d", read, expected);
         }
-
-        return true;
     }
 
-    void Clear() {
-        while(Pop<ElementType>(nullptr));
-    }
+    // waiter:   ++waiters, read epoch, try again, sleep on epoch
+    // notifier: change queue, read waiters, if any: ++epoch and wake
+    // both sides fence between their write and read, so either the waiter's retry sees
+    // the change, or the notifier sees the waiter and moves epoch under its futex. the
+    // epoch is bumped with release and read with acquire, so a waiter that reads the
+    // new epoch also sees the change made before it, and does not sleep on it
+    struct BlockingState {
+        alignas(CursorAlign) std::atomic<uint32_t> not_empty_epoch = ATOMIC_VAR_INIT(0);
+        std::atomic<uint32_t> pop_waiters = ATOMIC_VAR_INIT(0);
+        alignas(CursorAlign) std::atomic<uint32_t> not_full_epoch = ATOMIC_VAR_INIT(0);
+        std::atomic<uint32_t> push_waiters = ATOMIC_VAR_INIT(0);
+    };
 
-    size_t ApproximateSize() const {
-        return m_write.load(std::memory_order_relaxed) -
-            m_read.load(std::memory_order_relaxed);
+    struct NoBlockingState {
+    };
+
+    template<typename Function>
+    bool WaitFor(std::atomic<uint32_t> &epoch, std::atomic<uint32_t> &waiters,
+            const std::chrono::steady_clock::time_point *deadline, Function f) {
+        static_assert(Options::Blocking, "set Options::Blocking to use PushWait()/PopWait()");
+
+        for(;;) {
+            for(unsigned i = 0; i < Options::BlockingSpinCount; ++i) {
+                if(f()) {
+                    return true;
+                }
+            }
+
+            struct timespec ts;
+            struct timespec *timeout = nullptr;
+
+            if(deadline) {
+                std::chrono::steady_clock::duration left = *deadline - std::chrono::steady_clock::now();
+
+                if(left <= std::chrono::steady_clock::duration::zero()) {
+                    return f();
+                }
+
+                std::chrono::nanoseconds ns = std::chrono::duration_cast<std::chrono::nanoseconds>(left);
+                ts.tv_sec = (time_t)(ns.count() / 1000000000);
+                ts.tv_nsec = (long)(ns.count() % 1000000000);
+                timeout = &ts;
+            }
+
+            waiters.fetch_add(1u, std::memory_order_seq_cst);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+
+            // acquire: seeing a notifier's epoch means f() sees its change
+            uint32_t e = epoch.load(std::memory_order_acquire);
+
+            if(f()) {
+                waiters.fetch_sub(1u, std::memory_order_relaxed);
+                return true;
+            }
+
+            FutexWait(&epoch, e, timeout);
+
+            waiters.fetch_sub(1u, std::memory_order_relaxed);
+        }
     }
 
-private:
-    FixedQueue(const FixedQueue &);
-    FixedQueue(FixedQueue &&);
-    FixedQueue &operator=(const FixedQueue &);
-    FixedQueue &operator=(FixedQueue &&);
+    void Wake(std::atomic<uint32_t> &epoch, std::atomic<uint32_t> &waiters, size_t count) {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
 
-    static constexpr size_t ElementTypeSize = sizeof(ElementType);
+        if(waiters.load(std::memory_order_relaxed) != 0) {
+            epoch.fetch_add(1u, std::memory_order_release);
+            FutexWake(&epoch, count < (size_t)INT32_MAX ? (int)count : INT32_MAX);
+        }
+    }
 
-    struct ElementNode {
-        alignas(alignof(ElementType)) char buffer[ElementTypeSize];
-        std::atomic<int> rwref = ATOMIC_VAR_INIT(RWREF_EMPTY);
-    };
+    void NotifyPushed(size_t count) {
+        if constexpr (Options::Blocking) {
+            Wake(m_blocking.not_empty_epoch, m_blocking.pop_waiters, count);
+        }
+    }
+
+    void NotifyPopped(size_t count) {
+        if constexpr (Options::Blocking) {
+            Wake(m_blocking.not_full_epoch, m_blocking.push_waiters, count);
+        }
+    }
 
     template<typename ... Args>
     void ConstructElementAt(ElementNode *node, Args && ... args) {
@@ -158,14 +1066,90 @@ private:
         return (ElementType *)node->buffer;
     }
 
+    static constexpr bool IsDynamic = Capacity == FixedQueueDynamicCapacity;
+
+    // number of slots, pos is mapped to slot pos % RingSize
+    static constexpr size_t RingSize = Options::RoundUpCapacity ? RoundUpPowerOfTwo(Capacity) : Capacity;
+
+    size_t QueueCapacity() const {
+        if constexpr (IsDynamic) {
+            return m_capacity;
+        } else {
+            return Capacity;
+        }
+    }
+
+    size_t QueueRingSize() const {
+        if constexpr (IsDynamic) {
+            return m_ring_size;
+        } else {
+            return RingSize;
+        }
+    }
+
+    void InitSlots() {
+        if constexpr (IsTicketProtocol && !IsSpsc) {
+            for(size_t pos = 0; pos < QueueRingSize(); ++pos) {
+                m_element_nodes[ArrayIndex(pos)].state.store(TicketTurn(pos, TICKET_WRITABLE), std::memory_order_relaxed);
+            }
+        } else if constexpr (IsSequenceProtocol && !IsSpsc) {
+            // slot for pos is writable when its sequence equals pos
+            for(size_t pos = 0; pos < QueueRingSize(); ++pos) {
+                m_element_nodes[ArrayIndex(pos)].state.store(pos, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // interleaved layout: positions [0, lines * SlotsPerLine) are spread column by column,
+    // so pos and pos+1 are `lines` slots apart. the tail that does not fill
+    // a whole line keeps the compact mapping.
+    static constexpr size_t SlotsPerLine = sizeof(ElementNode) < CacheLineSize ?
+        CacheLineSize / sizeof(ElementNode) : 1;
+
     size_t ArrayIndex(size_t pos) const {
-        return pos % Capacity;
+        size_t index;
+        size_t lines;
+
+        if constexpr (IsDynamic) {
+            index = m_ring_mask ? pos & m_ring_mask : pos % m_ring_size;
+            lines = m_interleaved_lines;
+        } else if constexpr (IsPowerOfTwo(RingSize)) {
+            index = pos & (RingSize - 1u);
+            lines = RingSize / SlotsPerLine;
+        } else {
+            index = pos % RingSize;
+            lines = RingSize / SlotsPerLine;
+        }
+
+        if constexpr (Options::SlotLayout == FIXED_QUEUE_SLOT_INTERLEAVED && SlotsPerLine > 1) {
+            if(index < lines * SlotsPerLine) {
+                return (index % lines) * SlotsPerLine + index / lines;
+            }
+        }
+
+        return index;
     }
 
-    ElementNode m_element_nodes[Capacity];
+    // embedded slots, or mmap-ed slots for FixedQueueDynamicCapacity
+    using ElementNodeArray = typename std::conditional<IsDynamic, ElementNode *, ElementNode[IsDynamic ? 1 : RingSize]>::type;
+
+    alignas(ArrayAlign) ElementNodeArray m_element_nodes;
+
+    // FixedQueueDynamicCapacity only, read only after construction
+    size_t m_capacity = 0;
+    size_t m_ring_size = 0;
+    size_t m_ring_mask = 0; // m_ring_size - 1 if it is a power of two, else 0
+    size_t m_interleaved_lines = 0;
+    size_t m_mapped_bytes = 0;
+
+    alignas(CursorAlign) std::atomic<size_t> m_read = ATOMIC_VAR_INIT(0); // next read pos
+    size_t m_cached_write = 0; // SPSC only, reader's last seen m_write
+    alignas(CursorAlign) std::atomic<size_t> m_write = ATOMIC_VAR_INIT(0); // next write pos
+    size_t m_cached_read = 0; // SPSC only, writer's last seen m_read
 
-    std::atomic<size_t> m_read = ATOMIC_VAR_INIT(0); // next read pos
-    std::atomic<size_t> m_write = ATOMIC_VAR_INIT(0); // next write pos
+    typename std::conditional<Options::Blocking, BlockingState, NoBlockingState>::type m_blocking;
+
+    typename Options::Stats m_stats;
 
     // read start: RWREF_WRITTEN -> RWREF_READING
     // read finish: RWREF_READING -> RWREF_EMPTY
@@ -177,6 +1161,19 @@ private:
         RWREF_WRITING,
         RWREF_WRITTEN,
     };
+
+    // turn of a slot for one pos: writable -> writing -> readable, then writable for
+    // pos + ring size. a reader skipping the pos goes from writable to the next writable
+    enum TICKET_PHASE {
+        TICKET_WRITABLE = 0,
+        TICKET_WRITING,
+        TICKET_READABLE,
+    };
+
+    // pos and phase in one word, a later pos always compares greater
+    static constexpr size_t TicketTurn(size_t pos, int phase) {
+        return (pos << 2) | (size_t)phase;
+    }
 };
 
 #undef ASSERT_LOG
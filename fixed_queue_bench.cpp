@@ -0,0 +1,181 @@
+#include "fixed_queue.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread>
+#include <vector>
+#include <memory>
+#include <chrono>
+
+// usage: fixed_queue_bench.out [seconds_per_run] [max_threads]
+//
+// threads=1 alternates Push/Pop on one thread, otherwise half of the threads push
+// and the rest pop. ops/sec counts successful Push + Pop, per element for PushN/PopN.
+
+struct Payload {
+    unsigned long producer = 0;
+    unsigned long counter = 0;
+};
+
+static constexpr size_t BenchCapacity = 4096;
+
+// batch == 0 uses Push/Pop, otherwise PushN/PopN with batch elements per call
+template<typename Queue>
+static double RunThroughput(int threads, double seconds, size_t batch = 0) {
+    std::unique_ptr<Queue> q_p = std::make_unique<Queue>();
+    Queue &q = *q_p;
+
+    std::atomic<int> start = ATOMIC_VAR_INIT(0);
+    std::atomic<int> stop = ATOMIC_VAR_INIT(0);
+    std::atomic<unsigned long long> ops = ATOMIC_VAR_INIT(0);
+
+    std::vector<std::thread> workers;
+
+    auto pusher = [&](unsigned long index) {
+        unsigned long long n = 0;
+        Payload p;
+        p.producer = index;
+        std::vector<Payload> ps(batch, p);
+        while(!start.load(std::memory_order_acquire));
+        while(!stop.load(std::memory_order_relaxed)) {
+            if(batch) {
+                n += q.PushN(ps.begin(), ps.end());
+            } else if(q.Push(p)) {
+                ++p.counter;
+                ++n;
+            }
+        }
+        ops.fetch_add(n, std::memory_order_relaxed);
+    };
+
+    auto poper = [&]() {
+        unsigned long long n = 0;
+        Payload p;
+        std::vector<Payload> ps(batch);
+        while(!start.load(std::memory_order_acquire));
+        while(!stop.load(std::memory_order_relaxed)) {
+            if(batch) {
+                n += q.PopN(ps.begin(), batch);
+            } else if(q.Pop(&p)) {
+                ++n;
+            }
+        }
+        ops.fetch_add(n, std::memory_order_relaxed);
+    };
+
+    auto both = [&]() {
+        unsigned long long n = 0;
+        Payload p;
+        std::vector<Payload> ps(batch);
+        while(!start.load(std::memory_order_acquire));
+        while(!stop.load(std::memory_order_relaxed)) {
+            if(batch) {
+                n += q.PushN(ps.begin(), ps.end());
+                n += q.PopN(ps.begin(), batch);
+            } else {
+                n += q.Push(p);
+                n += q.Pop(&p);
+            }
+        }
+        ops.fetch_add(n, std::memory_order_relaxed);
+    };
+
+    if(threads == 1) {
+        workers.emplace_back(both);
+    } else {
+        for(int i = 0; i < threads / 2; ++i) {
+            workers.emplace_back(pusher, (unsigned long)i);
+        }
+        for(int i = threads / 2; i < threads; ++i) {
+            workers.emplace_back(poper);
+        }
+    }
+
+    auto begin = std::chrono::steady_clock::now();
+    start.store(1, std::memory_order_release);
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+    stop.store(1, std::memory_order_relaxed);
+
+    for(size_t i = 0; i < workers.size(); ++i) {
+        workers[i].join();
+    }
+
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    return ops.load() / elapsed;
+}
+
+template<typename Queue>
+static void RunSeries(const char *name, double seconds, int max_threads, size_t batch = 0) {
+    for(int threads = 1; threads <= max_threads; threads *= 2) {
+        double rate = RunThroughput<Queue>(threads, seconds, batch);
+        printf("%-12s threads=%-3d ops/sec=%.0f\n", name, threads, rate);
+        fflush(stdout);
+    }
+}
+
+// single thread, keep the queue half full and time Push + Pop pairs
+template<typename Queue>
+static void RunIndexCost(const char *name, size_t rounds) {
+    std::unique_ptr<Queue> q_p = std::make_unique<Queue>();
+    Queue &q = *q_p;
+    Payload p;
+
+    for(size_t i = 0; i < q.GetCapacity() / 2; ++i) {
+        q.Push(p);
+    }
+
+    auto begin = std::chrono::steady_clock::now();
+
+    for(size_t i = 0; i < rounds; ++i) {
+        q.Push(p);
+        q.Pop(&p);
+    }
+
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    printf("%-22s ns/op=%.2f\n", name, elapsed * 1e9 / (rounds * 2));
+    fflush(stdout);
+}
+
+struct RoundUpOptions : FixedQueueDefaultOptions {
+    static constexpr bool RoundUpCapacity = true;
+};
+
+struct SpscRoundUpOptions : FixedQueueSpscOptions {
+    static constexpr bool RoundUpCapacity = true;
+};
+
+int main(int argc, char **argv) {
+    double seconds = argc > 1 ? atof(argv[1]) : 1.0;
+    int max_threads = argc > 2 ? atoi(argv[2]) : 16;
+
+    printf("== slot / cursor layout, capacity=%lu ==\n", (unsigned long)BenchCapacity);
+    RunSeries<FixedQueue<Payload, BenchCapacity>>("compact", seconds, max_threads);
+    RunSeries<FixedQueue<Payload, BenchCapacity, FixedQueuePaddedOptions>>("padded", seconds, max_threads);
+    RunSeries<FixedQueue<Payload, BenchCapacity, FixedQueueInterleavedOptions>>("interleaved", seconds, max_threads);
+
+    printf("== slot protocol, capacity=%lu ==\n", (unsigned long)BenchCapacity);
+    RunSeries<FixedQueue<Payload, BenchCapacity>>("rwref", seconds, max_threads);
+    RunSeries<FixedQueue<Payload, BenchCapacity, FixedQueueSequenceOptions>>("sequence", seconds, max_threads);
+    RunSeries<FixedQueue<Payload, BenchCapacity, FixedQueueTicketOptions>>("ticket", seconds, max_threads);
+
+    printf("== PushN/PopN, batch=32, capacity=%lu ==\n", (unsigned long)BenchCapacity);
+    RunSeries<FixedQueue<Payload, BenchCapacity>>("rwref", seconds, max_threads, 32);
+    RunSeries<FixedQueue<Payload, BenchCapacity, FixedQueueSequenceOptions>>("sequence", seconds, max_threads, 32);
+    RunSeries<FixedQueue<Payload, BenchCapacity, FixedQueueTicketOptions>>("ticket", seconds, max_threads, 32);
+
+    printf("== concurrency mode, capacity=%lu ==\n", (unsigned long)BenchCapacity);
+    RunSeries<FixedQueue<Payload, BenchCapacity, FixedQueuePaddedOptions>>("mpmc", seconds, max_threads < 2 ? max_threads : 2);
+    RunSeries<FixedQueue<Payload, BenchCapacity, FixedQueueSpscOptions>>("spsc", seconds, max_threads < 2 ? max_threads : 2);
+
+    size_t rounds = (size_t)(seconds * 50000000);
+    printf("== index by mod / mask, single thread ==\n");
+    RunIndexCost<FixedQueue<Payload, 100000>>("mod 100000", rounds);
+    RunIndexCost<FixedQueue<Payload, 100000, RoundUpOptions>>("mask 100000 round-up", rounds);
+    RunIndexCost<FixedQueue<Payload, 131072>>("mask 131072", rounds);
+    RunIndexCost<FixedQueue<Payload, 100000, FixedQueueSpscOptions>>("spsc mod 100000", rounds);
+    RunIndexCost<FixedQueue<Payload, 100000, SpscRoundUpOptions>>("spsc mask 100000", rounds);
+
+    return 0;
+}
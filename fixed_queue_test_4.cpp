@@ -0,0 +1,92 @@
+#include "fixed_queue.h"
+
+#include <vector>
+#include <unordered_map>
+#include <memory>
+
+#include <signal.h>
+
+// PushN / PopN in bursts, 2 producers and 1 consumer per queue,
+// consumer checks every topic's counter is continuous
+
+static std::atomic<int> stop = ATOMIC_VAR_INIT(0);
+
+static void sig_handler(int sig) {
+    stop.store(1, std::memory_order_relaxed);
+}
+
+struct UserData {
+    int topic = 0;
+    unsigned long counter = 0;
+    std::vector<int> xx = {1,2,3,4,5,6,7,8,9,10,};
+};
+
+template<typename Queue>
+static void RunBatch(const char *name, std::vector<std::thread> &threads) {
+    std::shared_ptr<Queue> fq = std::make_shared<Queue>();
+
+    auto c = [fq, name] (int topic) {
+        unsigned long counter = 0;
+        std::vector<UserData> batch;
+
+        while(!stop.load(std::memory_order_relaxed)) {
+            size_t n = 32 + counter % 225;
+
+            batch.resize(n);
+
+            for(size_t i = 0; i < n; ++i) {
+                batch[i].topic = topic;
+                batch[i].counter = counter + i;
+            }
+
+            counter += fq->PushN(std::make_move_iterator(batch.begin()), std::make_move_iterator(batch.end()));
+        }
+
+        printf("%s SEND: topic=%d, counter=%lu\n", name, topic, counter);
+    };
+
+    for(int i = 0; i < 2; ++i) {
+        threads.emplace_back(c, i);
+    }
+
+    threads.emplace_back([fq, name]() {
+                std::unordered_map<int, unsigned long> next;
+                std::vector<UserData> batch;
+
+                while(!stop.load(std::memory_order_relaxed)) {
+                    batch.clear();
+
+                    fq->PopN(std::back_inserter(batch), 128);
+
+                    for(UserData &ud: batch) {
+                        unsigned long &expected = next[ud.topic];
+
+                        if(ud.counter != expected) {
+                            fprintf(stderr, "%s counter error, topic=%d, counter=%lu, expected=%lu\n", name, ud.topic, ud.counter, expected);
+                        }
+
+                        expected = ud.counter + 1u;
+                    }
+                }
+
+                for(auto iter = next.begin(); iter != next.end(); ++iter) {
+                    printf("%s RECV: topic=%d, counter=%lu\n", name, iter->first, iter->second);
+                }
+            });
+}
+
+int main() {
+    std::vector<std::thread> threads;
+
+    RunBatch<FixedQueue<UserData, 10000>>("rwref", threads);
+    RunBatch<FixedQueue<UserData, 10000, FixedQueueSequenceOptions>>("sequence", threads);
+
+    signal(SIGINT, sig_handler);
+    signal(SIGTERM, sig_handler);
+
+    for(size_t i = 0; i < threads.size(); ++i) {
+        threads[i].join();
+    }
+
+    return 0;
+}
@@ -0,0 +1,100 @@
+#include "fixed_queue.h"
+
+#include <vector>
+#include <unordered_map>
+#include <memory>
+
+#include <signal.h>
+
+// SPSC / MPSC / SPMC modes, each consumer checks every topic's counter only grows,
+// single consumer queues also check it is continuous
+
+static std::atomic<int> stop = ATOMIC_VAR_INIT(0);
+
+static void sig_handler(int sig) {
+    stop.store(1, std::memory_order_relaxed);
+}
+
+struct UserData {
+    int topic = 0;
+    unsigned long counter = 0;
+    std::vector<int> xx = {1,2,3,4,5,6,7,8,9,10,};
+};
+
+template<typename Queue>
+static void RunMode(const char *name, int writers, int readers, std::vector<std::thread> &threads) {
+    std::shared_ptr<Queue> fq = std::make_shared<Queue>();
+
+    auto c = [fq, name] (int topic) {
+        unsigned long counter = 0;
+
+        while(!stop.load(std::memory_order_relaxed)) {
+            UserData ud;
+            ud.topic = topic;
+            ud.counter = counter;
+
+            if(fq->Push(std::move(ud))) {
+                ++counter;
+            }
+        }
+
+        printf("%s SEND: topic=%d, counter=%lu\n", name, topic, counter);
+    };
+
+    auto r = [fq, name, readers] () {
+        std::unordered_map<int, unsigned long> latest;
+        unsigned long total = 0;
+
+        while(!stop.load(std::memory_order_relaxed)) {
+            UserData ud;
+
+            if(fq->Pop(&ud)) {
+                auto iter = latest.find(ud.topic);
+
+                if(iter != latest.end()) {
+                    if(readers == 1 ? ud.counter == iter->second + 1u : ud.counter > iter->second) {
+                        iter->second = ud.counter;
+                    } else {
+                        fprintf(stderr, "%s counter error, topic=%d, counter=%lu\n", name, ud.topic, ud.counter);
+                    }
+                } else {
+                    latest[ud.topic] = ud.counter;
+                }
+
+                ++total;
+            }
+        }
+
+        printf("%s RECV: total=%lu\n", name, total);
+    };
+
+    for(int i = 0; i < writers; ++i) {
+        threads.emplace_back(c, i);
+    }
+
+    for(int i = 0; i < readers; ++i) {
+        threads.emplace_back(r);
+    }
+}
+
+struct RwrefMpscOptions : FixedQueueDefaultOptions {
+    static constexpr bool MultiReader = false;
+};
+
+int main() {
+    std::vector<std::thread> threads;
+
+    RunMode<FixedQueue<UserData, 10000, FixedQueueSpscOptions>>("spsc", 1, 1, threads);
+    RunMode<FixedQueue<UserData, 10000, FixedQueueMpscOptions>>("mpsc", 2, 1, threads);
+    RunMode<FixedQueue<UserData, 10000, FixedQueueSpmcOptions>>("spmc", 1, 2, threads);
+    RunMode<FixedQueue<UserData, 10000, RwrefMpscOptions>>("rwref-mpsc", 2, 1, threads);
+
+    signal(SIGINT, sig_handler);
+    signal(SIGTERM, sig_handler);
+
+    for(size_t i = 0; i < threads.size(); ++i) {
+        threads[i].join();
+    }
+
+    return 0;
+}
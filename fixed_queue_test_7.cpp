@@ -0,0 +1,103 @@
+#include "fixed_queue.h"
+
+#include <vector>
+#include <unordered_map>
+#include <memory>
+
+#include <time.h>
+#include <signal.h>
+
+// bursty producers with PushWait(), consumer sleeps in PopWaitFor() between bursts.
+// consumer checks counters, and reports its cpu time against wall time
+
+static std::atomic<int> stop = ATOMIC_VAR_INIT(0);
+
+static void sig_handler(int sig) {
+    stop.store(1, std::memory_order_relaxed);
+}
+
+struct UserData {
+    int topic = 0;
+    unsigned long counter = 0;
+};
+
+struct BlockingOptions : FixedQueueSequenceOptions {
+    static constexpr bool Blocking = true;
+};
+
+static double ThreadCpuSeconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main() {
+    std::unique_ptr<FixedQueue<UserData, 1024, BlockingOptions>> fq_p =
+        std::make_unique<FixedQueue<UserData, 1024, BlockingOptions>>();
+    FixedQueue<UserData, 1024, BlockingOptions> &fq = *fq_p;
+
+    std::vector<std::thread> threads;
+
+    auto c = [&fq] (int topic) {
+        unsigned long counter = 0;
+
+        while(!stop.load(std::memory_order_relaxed)) {
+            // burst bigger than capacity, so PushWait() has to sleep too
+            for(int i = 0; i < 5000; ++i) {
+                UserData ud;
+                ud.topic = topic;
+                ud.counter = counter++;
+
+                fq.PushWait(ud);
+            }
+
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+
+        printf("SEND: topic=%d, counter=%lu\n", topic, counter);
+    };
+
+    for(int i = 0; i < 2; ++i) {
+        threads.emplace_back(c, i);
+    }
+
+    threads.emplace_back([&fq]() {
+                std::unordered_map<int, unsigned long> next;
+                std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+                double cpu_begin = ThreadCpuSeconds();
+                unsigned long timeouts = 0;
+
+                while(!stop.load(std::memory_order_relaxed) || fq.ApproximateSize() != 0) {
+                    UserData ud;
+
+                    if(fq.PopWaitFor(&ud, std::chrono::milliseconds(100))) {
+                        unsigned long &expected = next[ud.topic];
+
+                        if(ud.counter != expected) {
+                            fprintf(stderr, "counter error, topic=%d, counter=%lu, expected=%lu\n", ud.topic, ud.counter, expected);
+                        }
+
+                        expected = ud.counter + 1u;
+                    } else {
+                        ++timeouts;
+                    }
+                }
+
+                double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+                for(auto iter = next.begin(); iter != next.end(); ++iter) {
+                    printf("RECV: topic=%d, counter=%lu\n", iter->first, iter->second);
+                }
+
+                printf("RECV: timeouts=%lu, cpu=%.3fs, wall=%.3fs\n", timeouts, ThreadCpuSeconds() - cpu_begin, wall);
+            });
+
+    signal(SIGINT, sig_handler);
+    signal(SIGTERM, sig_handler);
+
+    for(size_t i = 0; i < threads.size(); ++i) {
+        threads[i].join();
+    }
+
+    return 0;
+}
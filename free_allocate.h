@@ -1,11 +1,19 @@
 #ifndef __FREE_ALLOCATE_H__
 #define __FREE_ALLOCATE_H__
 
+#include "cache_line.h"
+#include "mapped_memory.h"
+#include "queue_stats.h"
+#include "backoff.h"
+
 #include <atomic>
 #include <thread>
 #include <type_traits>
+#include <vector>
+#include <new>
 
 #include <stddef.h>
+#include <stdint.h>
 #include <assert.h>
 #include <stdio.h>
 #include <pthread.h>
@@ -16,54 +24,308 @@
         assert(0);\
     }
 
-template<typename ElementType>
+struct FreeAllocateDefaultOptions {
+    // free nodes cached per magazine slot, 0 disables the magazine layer.
+    // a full magazine goes back to the global free list with one CAS and
+    // an empty one is refilled with one CAS
+    static constexpr size_t MagazineSize = 0;
+    // threads are spread over this many magazine slots
+    static constexpr size_t MagazineSlots = 64;
+    // size of the slab table. 1 keeps the pool at its constructor capacity,
+    // more lets Allocate() map extra slabs on demand, see FreeAllocateGrowth
+    static constexpr size_t MaxSlabs = 1;
+    // false: free list head and links are 16 byte {pointer, version} pairs, which need
+    // cmpxchg16b (-mcx16) and libatomic. true: 8 byte {32 bit node index, 32 bit tag},
+    // handled by native 64 bit CAS. the pool is then limited to 2^32 - 1 nodes
+    static constexpr bool CompactHead = false;
+    // QueueStats<> counts allocations, free list contention and the low-water mark
+    // of free nodes, see GetStats()
+    using Stats = QueueNoStats;
+    // what a lost CAS on the free list head does before the next try, see backoff.h
+    using Backoff = BackoffDefault;
+};
+
+struct FreeAllocateCompactOptions : FreeAllocateDefaultOptions {
+    static constexpr bool CompactHead = true;
+};
+
+struct FreeAllocateMagazineOptions : FreeAllocateDefaultOptions {
+    static constexpr size_t MagazineSize = 64;
+};
+
+struct FreeAllocateElasticOptions : FreeAllocateDefaultOptions {
+    static constexpr size_t MaxSlabs = 64;
+};
+
+struct FreeAllocateElasticMagazineOptions : FreeAllocateMagazineOptions {
+    static constexpr size_t MaxSlabs = 64;
+};
+
+struct FreeAllocateStatsOptions : FreeAllocateDefaultOptions {
+    using Stats = QueueStats<>;
+};
+
+// growth policy of an elastic FreeAllocate (Options::MaxSlabs > 1)
+struct FreeAllocateGrowth {
+    // nodes per extra slab, 0 disables growth
+    size_t slab_capacity = 0;
+    // hard cap of nodes over all slabs, the constructor capacity included
+    size_t max_capacity = 0;
+};
+
+template<typename ElementType, typename Options = FreeAllocateDefaultOptions>
 class FreeAllocate {
+    static constexpr bool MagazineEnabled = Options::MagazineSize != 0;
+    static constexpr bool ElasticEnabled = Options::MaxSlabs > 1;
+    static constexpr bool CompactHead = Options::CompactHead;
+
+    static_assert(Options::MaxSlabs >= 1, "slab table needs the initial slab");
+
+    // head of a batch of free nodes in the global free list (magazine layer only).
+    // lives in the buffer of the head node, which is unused while the node is free.
+    // the rest of the batch is chained by next_node and private to the batch
+    struct MagazineBatch {
+        void *rest;
+        size_t count;
+    };
+
+    static constexpr size_t MaxSize(size_t a, size_t b) {
+        return a > b ? a : b;
+    }
+
+    static constexpr size_t BufferSize = MagazineEnabled ?
+        MaxSize(sizeof(ElementType), sizeof(MagazineBatch)) : sizeof(ElementType);
+    static constexpr size_t BufferAlign = MagazineEnabled ?
+        MaxSize(alignof(ElementType), alignof(MagazineBatch)) : alignof(ElementType);
+
 public:
-    FreeAllocate(size_t pool_capacity) : m_capacity(pool_capacity){
-        for(size_t i = 0; i < pool_capacity; ++i) {
-            ElementFreeNode *elem_node = CreateElementFreeNode();
-            PushElementFreeNode(elem_node);
-        }
+    // initial nodes come from one mapped slab. throw std::bad_alloc if it can not be mapped.
+    // growth is ignored unless Options::MaxSlabs > 1
+    FreeAllocate(size_t pool_capacity, const MappedMemoryOptions &memory_options = MappedMemoryOptions(),
+            const FreeAllocateGrowth &growth = FreeAllocateGrowth()) :
+        m_capacity(pool_capacity), m_growth(growth), m_memory_options(memory_options) {
+        Slab *slab = &m_slabs[0];
+
+        ASSERT_LOG(!CompactHead || pool_capacity < CompactMaxNodes, "pool capacity %lu does not fit in a compact head", (unsigned long)pool_capacity);
+
+        slab->nodes = CreateSlab(pool_capacity, memory_options, &slab->mapped_bytes);
+        slab->count = pool_capacity;
+        slab->state.store(SLAB_ACTIVE, std::memory_order_relaxed);
+        m_slab_count.store(1u, std::memory_order_relaxed);
+
+        PushSlab(slab->nodes, pool_capacity, 0, 0);
     }
 
     ~FreeAllocate() {
-        Clear();
+        // ElementFreeNode is trivially destructible, nodes go away with their slab
+        size_t slab_count = m_slab_count.load(std::memory_order_acquire);
+
+        for(size_t i = 0; i < slab_count; ++i) {
+            MappedMemoryFree(m_slabs[i].nodes, m_slabs[i].mapped_bytes);
+        }
     }
 
-    struct ElementFreeNode;
+    struct VersionedFreeNode;
 
-    struct alignas(sizeof(ElementFreeNode *) + sizeof(unsigned long)) ElementVersionPointer {
-        ElementFreeNode *pointer;
+    struct alignas(sizeof(VersionedFreeNode *) + sizeof(unsigned long)) ElementVersionPointer {
+        VersionedFreeNode *pointer;
         unsigned long version;
     };
 
-    struct ElementFreeNode {
-        alignas(alignof(ElementType)) char buffer[sizeof(ElementType)];
+    struct VersionedFreeNode {
+        VersionedFreeNode() = default;
+
+        VersionedFreeNode(ElementVersionPointer next, size_t index) : next_node(next) {}
+
+        alignas(BufferAlign) char buffer[BufferSize];
         std::atomic<ElementVersionPointer> next_node = ATOMIC_VAR_INIT(((ElementVersionPointer){nullptr, 0}));
     };
 
+    // next_node keeps index + 1 of the next node in the low 32 bits (0 is nullptr)
+    // and the ABA tag in the high 32 bits. index is the node's own place in the pool
+    struct CompactFreeNode {
+        CompactFreeNode() = default;
+
+        CompactFreeNode(uint64_t next, size_t index) : next_node(next), index((uint32_t)index) {}
+
+        alignas(BufferAlign) char buffer[BufferSize];
+        std::atomic<uint64_t> next_node = ATOMIC_VAR_INIT(0);
+        uint32_t index = 0;
+    };
+
+    using ElementFreeNode = typename std::conditional<CompactHead, CompactFreeNode, VersionedFreeNode>::type;
+
+    // value of the free list head, of ElementFreeNode::next_node and of LinkedQueue cursors.
+    // only use it through MakeLink(), LinkPointer() and LinkVersion()
+    using ElementLink = typename std::conditional<CompactHead, uint64_t, ElementVersionPointer>::type;
+
+    ElementLink MakeLink(ElementFreeNode *pointer, unsigned long version) const {
+        if constexpr (CompactHead) {
+            return MakeLinkTo(pointer, pointer ? pointer->index : 0u, version);
+        } else {
+            return ElementVersionPointer{pointer, version};
+        }
+    }
+
+    ElementFreeNode *LinkPointer(ElementLink link) const {
+        if constexpr (CompactHead) {
+            uint32_t index = (uint32_t)link;
+
+            return index ? NodeAt(index - 1u) : nullptr;
+        } else {
+            return link.pointer;
+        }
+    }
+
+    unsigned long LinkVersion(ElementLink link) const {
+        if constexpr (CompactHead) {
+            return (unsigned long)(link >> 32);
+        } else {
+            return link.version;
+        }
+    }
+
+    static bool SameLink(ElementLink a, ElementLink b) {
+        if constexpr (CompactHead) {
+            return a == b;
+        } else {
+            return a.pointer == b.pointer && a.version == b.version;
+        }
+    }
+
+    // true if elem_node comes from one of the slabs, false for nodes made elsewhere
+    bool Contains(ElementFreeNode *elem_node) const {
+        size_t slab_count = m_slab_count.load(std::memory_order_acquire);
+
+        for(size_t i = 0; i < slab_count; ++i) {
+            const Slab *slab = &m_slabs[i];
+
+            if(slab->state.load(std::memory_order_acquire) == SLAB_ACTIVE &&
+                    elem_node >= slab->nodes && elem_node < slab->nodes + slab->count) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    // nodes over all committed slabs, grows and shrinks with an elastic pool
     size_t GetCapacity() const {
-        return m_capacity;
+        return m_capacity.load(std::memory_order_relaxed);
+    }
+
+    // all zero unless Options::Stats counts
+    QueueStatsSnapshot GetStats() const {
+        return m_stats.Snapshot();
     }
 
     ElementFreeNode *Allocate() {
-        ElementFreeNode *p = PopElementFreeNode();
-        return p;
+        ElementFreeNode *elem_node = TakeElementFreeNode();
+
+        if constexpr (ElasticEnabled) {
+            while(!elem_node && Grow(&elem_node)) {
+                if(!elem_node) {
+                    elem_node = TakeElementFreeNode();
+                }
+            }
+        }
+
+        if constexpr (Options::Stats::Enabled) {
+            if(elem_node) {
+                m_stats.Add(QUEUE_STAT_ALLOCATE);
+                m_stats.TrackPool(1, m_capacity.load(std::memory_order_relaxed));
+            } else {
+                m_stats.Add(QUEUE_STAT_ALLOCATE_FAILURE);
+            }
+        }
+
+        return elem_node;
     }
 
     void Deallocate(ElementFreeNode *elem_node) {
-        PushElementFreeNode(elem_node);
+        if constexpr (Options::Stats::Enabled) {
+            m_stats.Add(QUEUE_STAT_DEALLOCATE);
+            m_stats.TrackPool(-1, m_capacity.load(std::memory_order_relaxed));
+        }
+
+        if constexpr (MagazineEnabled) {
+            DeallocateToMagazine(elem_node);
+        } else {
+            PushElementFreeNode(elem_node);
+        }
     }
 
+    // drop all free nodes, Allocate() returns nullptr until nodes are deallocated again.
+    // memory is released when FreeAllocate is destructed. NOT thread safe
     void Clear() {
-        for(;;) {
-            ElementFreeNode *elem_node = PopElementFreeNode();
+        if constexpr (MagazineEnabled) {
+            for(size_t i = 0; i < Options::MagazineSlots; ++i) {
+                m_magazine_slots[i].head = nullptr;
+                m_magazine_slots[i].count = 0;
+            }
+        }
 
-            if(!elem_node) {
-                break;
+        while(PopBatch());
+    }
+
+    // give extra slabs whose nodes are all free back to the OS, call it when usage has
+    // stayed low for a while. the initial slab is kept. a released slab keeps its address
+    // range, so a racing thread reading a stale node sees zeros and fails its version CAS,
+    // and the next Grow() commits the range again. Allocate() waits while Shrink() holds
+    // the free list. return the number of nodes released
+    size_t Shrink() {
+        if constexpr (!ElasticEnabled) {
+            return 0;
+        } else {
+            if(m_shrinking.exchange(true, std::memory_order_acquire)) {
+                // another Shrink() is running
+                return 0;
+            }
+
+            std::vector<ElementFreeNode *> free_nodes;
+            TakeAllFreeNodes(&free_nodes);
+
+            size_t slab_count = m_slab_count.load(std::memory_order_acquire);
+            std::vector<size_t> slab_indexes(free_nodes.size());
+            std::vector<size_t> free_counts(slab_count + 1u, 0);
+            std::vector<bool> released_slabs(slab_count + 1u, false);
+            std::vector<ElementFreeNode *> keep_nodes;
+            size_t released = 0;
+
+            for(size_t i = 0; i < free_nodes.size(); ++i) {
+                slab_indexes[i] = SlabIndexOf(free_nodes[i], slab_count);
+                ++free_counts[slab_indexes[i]];
+            }
+
+            // free_counts[i] is only non zero for slabs that were active, and only Shrink()
+            // moves an active slab on
+            for(size_t i = 1; i < slab_count; ++i) {
+                Slab *slab = &m_slabs[i];
+
+                if(free_counts[i] && free_counts[i] == slab->count) {
+                    released += slab->count;
+                    released_slabs[i] = true;
+                    ReleaseSlab(slab);
+                }
             }
 
-            DestroyElementFreeNode(elem_node);
+            for(size_t i = 0; i < free_nodes.size(); ++i) {
+                if(!released_slabs[slab_indexes[i]]) {
+                    keep_nodes.push_back(free_nodes[i]);
+                }
+            }
+
+            ElementFreeNode **nodes = keep_nodes.data();
+
+            PushChain(keep_nodes.size(), [nodes](size_t i) {
+                    return nodes[i];
+                    }, [this](ElementFreeNode *elem_node, ElementFreeNode *next_node) {
+                    LinkLocal(elem_node, next_node);
+                    });
+
+            m_shrinking.store(false, std::memory_order_release);
+
+            return released;
         }
     }
 
@@ -103,29 +365,464 @@ private:
     FreeAllocate &operator=(const FreeAllocate &);
     FreeAllocate &operator=(FreeAllocate &&);
 
-    ElementFreeNode *CreateElementFreeNode() {
-        return new ElementFreeNode();
+    ElementFreeNode *CreateSlab(size_t count, const MappedMemoryOptions &memory_options, size_t *mapped_bytes) {
+        ElementFreeNode *nodes = (ElementFreeNode *)MappedMemoryAllocate(count * sizeof(ElementFreeNode), memory_options, mapped_bytes);
+
+        if(!nodes) {
+            throw std::bad_alloc();
+        }
+
+        return nodes;
     }
 
-    void DestroyElementFreeNode(ElementFreeNode *elem_node) {
-        delete elem_node;
+    // construct the nodes of a new slab already chained in address order and splice them
+    // into the free list with one CAS. nodes are handed out front to back, and neighbours
+    // in the list are neighbours in memory
+    void PushSlab(ElementFreeNode *nodes, size_t count, unsigned long version, size_t first_index) {
+        PushChain(count, [nodes](size_t i) {
+                return &nodes[i];
+                }, [this, nodes, version, first_index](ElementFreeNode *elem_node, ElementFreeNode *next_node) {
+                // next_node is not constructed yet, its index comes from its address
+                size_t next_index = next_node ? first_index + (size_t)(next_node - nodes) : 0u;
+
+                new (elem_node) ElementFreeNode(MakeLinkTo(next_node, next_index, version), first_index + (size_t)(elem_node - nodes));
+                });
     }
 
-    void PushElementFreeNode(ElementFreeNode *elem_node) {
-        ElementVersionPointer read_write = m_read_write.load(std::memory_order_acquire);
-        ElementVersionPointer elem_next_node = elem_node->next_node.load(std::memory_order_relaxed);
+    static constexpr size_t CompactMaxNodes = 0xffffffffu;
+
+    ElementLink MakeLinkTo(ElementFreeNode *pointer, size_t index, unsigned long version) const {
+        if constexpr (CompactHead) {
+            return ((uint64_t)(uint32_t)version << 32) | (pointer ? (uint64_t)index + 1u : 0u);
+        } else {
+            return ElementVersionPointer{pointer, version};
+        }
+    }
+
+    // node of a pool index, slabs are laid out back to back in index space
+    ElementFreeNode *NodeAt(size_t index) const {
+        const Slab *slab = &m_slabs[0];
+
+        if constexpr (ElasticEnabled) {
+            if(index >= slab->count) {
+                slab = &m_slabs[1u + (index - slab->count) / m_growth.slab_capacity];
+            }
+        }
+
+        return slab->nodes + (index - slab->first_index);
+    }
+
+    // chain count nodes into batches and splice them into the free list with one CAS.
+    // node_at(i) gives the i-th node, link(node, next) sets its next node
+    template<typename NodeAt, typename Link>
+    void PushChain(size_t count, NodeAt node_at, Link link) {
+        size_t batch_size = MagazineEnabled ? Options::MagazineSize : 1u;
+        ElementFreeNode *last_head = nullptr;
+
+        for(size_t i = 0; i < count; i += batch_size) {
+            size_t end = i + batch_size < count ? i + batch_size : count;
+
+            // batch head links to next batch head, the rest of the batch is chained privately
+            link(node_at(i), end < count ? node_at(end) : nullptr);
+
+            for(size_t j = i + 1u; j < end; ++j) {
+                link(node_at(j), j + 1u < end ? node_at(j + 1u) : nullptr);
+            }
+
+            if constexpr (MagazineEnabled) {
+                new (node_at(i)->buffer) MagazineBatch{i + 1u < end ? node_at(i + 1u) : nullptr, end - i};
+            }
+
+            last_head = node_at(i);
+        }
+
+        if(count) {
+            PushElementFreeNodes(node_at(0), last_head);
+        }
+    }
+
+    enum SLAB_STATE {
+        SLAB_UNUSED = 0,
+        SLAB_GROWING,
+        SLAB_ACTIVE,
+        SLAB_DECOMMITTED,
+    };
+
+    // fields are written before state turns SLAB_ACTIVE and stay put afterwards,
+    // a decommitted slab is committed again at the same address
+    struct Slab {
+        std::atomic<int> state = ATOMIC_VAR_INIT(SLAB_UNUSED);
+        ElementFreeNode *nodes = nullptr;
+        size_t count = 0;
+        size_t mapped_bytes = 0;
+        // versions of a committed again slab start here, so no stale CAS can match
+        unsigned long version_base = 0;
+        // pool index of nodes[0]
+        size_t first_index = 0;
+    };
+
+    // add count to m_capacity unless it goes over the hard cap
+    bool ReserveCapacity(size_t count) {
+        size_t capacity = m_capacity.load(std::memory_order_relaxed);
+        do {
+            if(capacity + count > m_growth.max_capacity) {
+                return false;
+            }
+        } while(!m_capacity.compare_exchange_weak(capacity, capacity + count, std::memory_order_relaxed));
+
+        return true;
+    }
+
+    // thread the nodes of a reserved slab, keep the first node for the caller
+    ElementFreeNode *ActivateSlab(Slab *slab) {
+        ElementFreeNode *nodes = slab->nodes;
+
+        // active before any node is handed out, see Contains()
+        slab->state.store(SLAB_ACTIVE, std::memory_order_release);
+        m_stats.Add(QUEUE_STAT_GROW);
+        new (&nodes[0]) ElementFreeNode(MakeLinkTo(nullptr, 0, slab->version_base), slab->first_index);
+        PushSlab(nodes + 1, slab->count - 1u, slab->version_base, slab->first_index + 1u);
+
+        return &nodes[0];
+    }
+
+    // called when no free node is left. every thread may grow on its own, no thread
+    // waits for another one: slab index and capacity are reserved with CAS before mmap.
+    // return false if the pool can not grow, true if the caller should try again,
+    // *elem_node receives a node of the new slab
+    bool Grow(ElementFreeNode **elem_node) {
+        if(m_shrinking.load(std::memory_order_acquire)) {
+            // Shrink() holds the free nodes for a moment
+            std::this_thread::yield();
+            return true;
+        }
+
+        if(!m_growth.slab_capacity) {
+            return false;
+        }
+
+        size_t slab_count = m_slab_count.load(std::memory_order_acquire);
+
+        // committing a released slab again saves the mmap
+        for(size_t i = 1; i < slab_count; ++i) {
+            Slab *slab = &m_slabs[i];
+            int expected = SLAB_DECOMMITTED;
+
+            if(slab->state.load(std::memory_order_relaxed) == SLAB_DECOMMITTED &&
+                    slab->state.compare_exchange_strong(expected, SLAB_GROWING, std::memory_order_acquire)) {
+                if(!ReserveCapacity(slab->count)) {
+                    slab->state.store(SLAB_DECOMMITTED, std::memory_order_release);
+                    return false;
+                }
+
+                *elem_node = ActivateSlab(slab);
+                return true;
+            }
+        }
+
+        size_t capacity = m_capacity.load(std::memory_order_relaxed);
+
+        if(capacity >= m_growth.max_capacity) {
+            return false;
+        }
+
+        size_t count = m_growth.max_capacity - capacity < m_growth.slab_capacity ?
+            m_growth.max_capacity - capacity : m_growth.slab_capacity;
+
+        if(!ReserveCapacity(count)) {
+            // another thread grew in between
+            return true;
+        }
+
+        size_t index = m_slab_count.load(std::memory_order_relaxed);
         do {
-            elem_node->next_node.store({read_write.pointer, elem_next_node.version + 1u}, std::memory_order_relaxed);
-        } while(!m_read_write.compare_exchange_strong(read_write, {elem_node, read_write.version + 1u},
+            if(index == Options::MaxSlabs) {
+                m_capacity.fetch_sub(count, std::memory_order_relaxed);
+                return false;
+            }
+        } while(!m_slab_count.compare_exchange_weak(index, index + 1u, std::memory_order_acq_rel));
+
+        Slab *slab = &m_slabs[index];
+
+        slab->first_index = m_slabs[0].count + (index - 1u) * m_growth.slab_capacity;
+
+        if(CompactHead && slab->first_index + count >= CompactMaxNodes) {
+            // out of index space, the table entry stays unused
+            m_capacity.fetch_sub(count, std::memory_order_relaxed);
+            return false;
+        }
+
+        slab->nodes = (ElementFreeNode *)MappedMemoryAllocate(count * sizeof(ElementFreeNode), m_memory_options, &slab->mapped_bytes);
+
+        if(!slab->nodes) {
+            // the table entry stays unused
+            m_capacity.fetch_sub(count, std::memory_order_relaxed);
+            return false;
+        }
+
+        slab->count = count;
+        *elem_node = ActivateSlab(slab);
+        return true;
+    }
+
+    // decommit a slab whose nodes are all owned by Shrink()
+    void ReleaseSlab(Slab *slab) {
+        unsigned long version_base = slab->version_base;
+
+        for(size_t i = 0; i < slab->count; ++i) {
+            unsigned long version = LinkVersion(slab->nodes[i].next_node.load(std::memory_order_relaxed)) + 1u;
+            version_base = version > version_base ? version : version_base;
+        }
+
+        slab->version_base = version_base;
+        MappedMemoryDecommit(slab->nodes, slab->mapped_bytes);
+        m_capacity.fetch_sub(slab->count, std::memory_order_relaxed);
+        slab->state.store(SLAB_DECOMMITTED, std::memory_order_release);
+    }
+
+    // slab_count if elem_node belongs to no active slab
+    size_t SlabIndexOf(ElementFreeNode *elem_node, size_t slab_count) {
+        for(size_t i = 0; i < slab_count; ++i) {
+            Slab *slab = &m_slabs[i];
+
+            if(slab->state.load(std::memory_order_acquire) == SLAB_ACTIVE &&
+                    elem_node >= slab->nodes && elem_node < slab->nodes + slab->count) {
+                return i;
+            }
+        }
+
+        return slab_count;
+    }
+
+    // empty the global free list with one CAS and flush idle magazines into *out
+    void TakeAllFreeNodes(std::vector<ElementFreeNode *> *out) {
+        ElementLink read_write = m_read_write.load(std::memory_order_acquire);
+        while(!m_read_write.compare_exchange_weak(read_write, MakeLink(nullptr, LinkVersion(read_write) + 1u),
                     std::memory_order_seq_cst, std::memory_order_acquire));
+
+        for(ElementFreeNode *head = LinkPointer(read_write); head; ) {
+            ElementFreeNode *next_head = NextLocal(head);
+
+            out->push_back(head);
+
+            if constexpr (MagazineEnabled) {
+                ElementFreeNode *elem_node = (ElementFreeNode *)((MagazineBatch *)head->buffer)->rest;
+
+                for(; elem_node; elem_node = NextLocal(elem_node)) {
+                    out->push_back(elem_node);
+                }
+            }
+
+            head = next_head;
+        }
+
+        if constexpr (MagazineEnabled) {
+            // a busy slot is skipped, its slab just stays committed
+            for(size_t i = 0; i < Options::MagazineSlots; ++i) {
+                MagazineSlot *slot = TryLockSlot(i);
+
+                if(slot) {
+                    for(ElementFreeNode *elem_node = slot->head; elem_node; elem_node = NextLocal(elem_node)) {
+                        out->push_back(elem_node);
+                    }
+
+                    slot->head = nullptr;
+                    slot->count = 0;
+                    UnlockSlot(slot);
+                }
+            }
+        }
+    }
+
+    ElementFreeNode *TakeElementFreeNode() {
+        if constexpr (MagazineEnabled) {
+            return AllocateFromMagazine();
+        } else {
+            return PopElementFreeNode();
+        }
+    }
+
+    void PushElementFreeNode(ElementFreeNode *elem_node) {
+        PushElementFreeNodes(elem_node, elem_node);
+    }
+
+    // push the chain first -> ... -> last with one CAS
+    void PushElementFreeNodes(ElementFreeNode *first, ElementFreeNode *last) {
+        ElementLink read_write = m_read_write.load(std::memory_order_acquire);
+        ElementLink last_next_node = last->next_node.load(std::memory_order_relaxed);
+        ElementLink first_link = MakeLink(first, 0);
+        typename Options::Backoff backoff;
+        for(;;) {
+            // the link already holds the index, only the tag changes per attempt
+            last->next_node.store(WithVersion(read_write, LinkVersion(last_next_node) + 1u), std::memory_order_relaxed);
+
+            if(m_read_write.compare_exchange_strong(read_write, WithVersion(first_link, LinkVersion(read_write) + 1u),
+                        std::memory_order_seq_cst, std::memory_order_acquire)) {
+                break;
+            }
+
+            m_stats.Add(QUEUE_STAT_FREE_LIST_CAS_FAILURE);
+            backoff.Retry();
+        }
+    }
+
+    // chain nodes that only this thread can see
+    void LinkLocal(ElementFreeNode *elem_node, ElementFreeNode *next_node) {
+        ElementLink elem_next_node = elem_node->next_node.load(std::memory_order_relaxed);
+        elem_node->next_node.store(MakeLink(next_node, LinkVersion(elem_next_node) + 1u), std::memory_order_relaxed);
+    }
+
+    ElementFreeNode *NextLocal(ElementFreeNode *elem_node) {
+        return LinkPointer(elem_node->next_node.load(std::memory_order_relaxed));
+    }
+
+    // same target as link, new version
+    ElementLink WithVersion(ElementLink link, unsigned long version) const {
+        if constexpr (CompactHead) {
+            return (link & 0xffffffffu) | ((uint64_t)(uint32_t)version << 32);
+        } else {
+            return ElementVersionPointer{link.pointer, version};
+        }
+    }
+
+    // push count nodes chained from head with one CAS
+    void PushBatch(ElementFreeNode *head, size_t count) {
+        if constexpr (MagazineEnabled) {
+            new (head->buffer) MagazineBatch{NextLocal(head), count};
+        }
+
+        PushElementFreeNode(head);
+    }
+
+    // pop a whole batch with one CAS, the batch is chained from the returned head
+    ElementFreeNode *PopBatch() {
+        ElementFreeNode *head = PopElementFreeNode();
+
+        if constexpr (MagazineEnabled) {
+            if(head) {
+                LinkLocal(head, (ElementFreeNode *)((MagazineBatch *)head->buffer)->rest);
+            }
+        }
+
+        return head;
+    }
+
+    size_t BatchCount(ElementFreeNode *head) {
+        if constexpr (MagazineEnabled) {
+            return ((MagazineBatch *)head->buffer)->count;
+        } else {
+            return 1u;
+        }
+    }
+
+    // a thread owns a slot while busy is set. slots are cache line aligned, so with
+    // fewer threads than slots lock and cached nodes stay in the owner's cache
+    struct alignas(CacheLineSize) MagazineSlot {
+        std::atomic<bool> busy = ATOMIC_VAR_INIT(false);
+        size_t count = 0;
+        ElementFreeNode *head = nullptr;
+    };
+
+    struct NoMagazineSlot {
+    };
+
+    MagazineSlot *TryLockSlot(size_t index) {
+        MagazineSlot *slot = &m_magazine_slots[index % Options::MagazineSlots];
+
+        if(slot->busy.load(std::memory_order_relaxed) || slot->busy.exchange(true, std::memory_order_acquire)) {
+            return nullptr;
+        }
+
+        return slot;
+    }
+
+    void UnlockSlot(MagazineSlot *slot) {
+        slot->busy.store(false, std::memory_order_release);
+    }
+
+    // take one node from slot, refill slot from global free list when it is empty
+    ElementFreeNode *TakeFromSlot(MagazineSlot *slot, bool refill) {
+        if(!slot->head && refill) {
+            ElementFreeNode *head = PopBatch();
+
+            if(head) {
+                slot->head = head;
+                slot->count = BatchCount(head);
+            }
+        }
+
+        ElementFreeNode *elem_node = slot->head;
+
+        if(elem_node) {
+            slot->head = NextLocal(elem_node);
+            --slot->count;
+        }
+
+        return elem_node;
+    }
+
+    ElementFreeNode *AllocateFromMagazine() {
+        size_t ordinal = ThreadOrdinal();
+        ElementFreeNode *elem_node = nullptr;
+        MagazineSlot *slot = TryLockSlot(ordinal);
+
+        if(slot) {
+            elem_node = TakeFromSlot(slot, true);
+            UnlockSlot(slot);
+        } else {
+            // slot is used by another thread right now, take from global directly
+            elem_node = PopBatch();
+
+            if(elem_node && BatchCount(elem_node) > 1u) {
+                PushBatch(NextLocal(elem_node), BatchCount(elem_node) - 1u);
+            }
+        }
+
+        if(!elem_node) {
+            // global free list is empty, but other slots may still cache nodes
+            for(size_t i = 1; i < Options::MagazineSlots && !elem_node; ++i) {
+                slot = TryLockSlot(ordinal + i);
+
+                if(slot) {
+                    elem_node = TakeFromSlot(slot, false);
+                    UnlockSlot(slot);
+                }
+            }
+        }
+
+        return elem_node;
+    }
+
+    void DeallocateToMagazine(ElementFreeNode *elem_node) {
+        MagazineSlot *slot = TryLockSlot(ThreadOrdinal());
+
+        if(!slot) {
+            LinkLocal(elem_node, nullptr);
+            PushBatch(elem_node, 1u);
+            return;
+        }
+
+        if(slot->count == Options::MagazineSize) {
+            // magazine is full, move it to global free list as a whole
+            PushBatch(slot->head, slot->count);
+            slot->head = nullptr;
+            slot->count = 0;
+        }
+
+        LinkLocal(elem_node, slot->head);
+        slot->head = elem_node;
+        ++slot->count;
+
+        UnlockSlot(slot);
     }
 
     ElementFreeNode *PopElementFreeNode() {
-        ElementVersionPointer read_write = m_read_write.load(std::memory_order_acquire);
+        ElementLink read_write = m_read_write.load(std::memory_order_acquire);
         ElementFreeNode *elem_node;
-        ElementVersionPointer next_elem_node;
-        do {
-            elem_node = read_write.pointer;
+        ElementLink next_elem_node;
+        typename Options::Backoff backoff;
+        for(;;) {
+            elem_node = LinkPointer(read_write);
 
             if(!elem_node) {
                 // pool is empty
@@ -133,15 +830,33 @@ private:
             }
 
             next_elem_node = elem_node->next_node.load(std::memory_order_relaxed);
-        } while(!m_read_write.compare_exchange_strong(read_write, {next_elem_node.pointer, read_write.version + 1u},
-                    std::memory_order_seq_cst, std::memory_order_acquire));
+
+            if(m_read_write.compare_exchange_strong(read_write, WithVersion(next_elem_node, LinkVersion(read_write) + 1u),
+                        std::memory_order_seq_cst, std::memory_order_acquire)) {
+                break;
+            }
+
+            m_stats.Add(QUEUE_STAT_FREE_LIST_CAS_FAILURE);
+            backoff.Retry();
+        }
 
         return elem_node;
     }
 
-    std::atomic<ElementVersionPointer> m_read_write = ATOMIC_VAR_INIT(((ElementVersionPointer){nullptr, 0}));
+    std::atomic<ElementLink> m_read_write = ATOMIC_VAR_INIT(ElementLink());
+
+    typename std::conditional<MagazineEnabled, MagazineSlot[Options::MagazineSlots], NoMagazineSlot>::type m_magazine_slots;
+
+    std::atomic<size_t> m_capacity;
+
+    Slab m_slabs[Options::MaxSlabs];
+    std::atomic<size_t> m_slab_count = ATOMIC_VAR_INIT(0);
+    std::atomic<bool> m_shrinking = ATOMIC_VAR_INIT(false);
+
+    FreeAllocateGrowth m_growth;
+    MappedMemoryOptions m_memory_options;
 
-    size_t m_capacity;
+    typename Options::Stats m_stats;
 };
 
 #undef ASSERT_LOG
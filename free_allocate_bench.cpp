@@ -0,0 +1,179 @@
+#include "free_allocate.h"
+#include "linked_queue.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread>
+#include <vector>
+#include <memory>
+#include <chrono>
+
+// usage: free_allocate_bench.out [seconds_per_run] [max_threads]
+//
+// 16 byte {pointer, version} head (cmpxchg16b / libatomic) against the compact
+// 8 byte {index, tag} head. FreeAllocate: every thread runs Allocate/Deallocate pairs.
+// LinkedQueue: threads=1 alternates Push/Pop, otherwise half push and half pop.
+// ops/sec counts successful operations.
+
+struct Payload {
+    unsigned long producer = 0;
+    unsigned long counter = 0;
+};
+
+static constexpr size_t BenchCapacity = 4096;
+
+template<typename FreeAllocateType>
+static double RunAllocate(int threads, double seconds) {
+    using ElementFreeNode = typename FreeAllocateType::ElementFreeNode;
+
+    std::unique_ptr<FreeAllocateType> a_p = std::make_unique<FreeAllocateType>(BenchCapacity);
+    FreeAllocateType &a = *a_p;
+
+    std::atomic<int> start = ATOMIC_VAR_INIT(0);
+    std::atomic<int> stop = ATOMIC_VAR_INIT(0);
+    std::atomic<unsigned long long> ops = ATOMIC_VAR_INIT(0);
+
+    std::vector<std::thread> workers;
+
+    auto job = [&]() {
+        unsigned long long n = 0;
+        while(!start.load(std::memory_order_acquire));
+        while(!stop.load(std::memory_order_relaxed)) {
+            ElementFreeNode *elem_node = a.Allocate();
+
+            if(elem_node) {
+                a.Deallocate(elem_node);
+                n += 2;
+            }
+        }
+        ops.fetch_add(n, std::memory_order_relaxed);
+    };
+
+    for(int i = 0; i < threads; ++i) {
+        workers.emplace_back(job);
+    }
+
+    auto begin = std::chrono::steady_clock::now();
+    start.store(1, std::memory_order_release);
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+    stop.store(1, std::memory_order_relaxed);
+
+    for(size_t i = 0; i < workers.size(); ++i) {
+        workers[i].join();
+    }
+
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    return ops.load() / elapsed;
+}
+
+template<typename Queue>
+static double RunQueue(int threads, double seconds) {
+    std::unique_ptr<Queue> q_p = std::make_unique<Queue>(BenchCapacity);
+    Queue &q = *q_p;
+
+    std::atomic<int> start = ATOMIC_VAR_INIT(0);
+    std::atomic<int> stop = ATOMIC_VAR_INIT(0);
+    std::atomic<unsigned long long> ops = ATOMIC_VAR_INIT(0);
+
+    std::vector<std::thread> workers;
+
+    auto pusher = [&](unsigned long index) {
+        unsigned long long n = 0;
+        Payload p;
+        p.producer = index;
+        while(!start.load(std::memory_order_acquire));
+        while(!stop.load(std::memory_order_relaxed)) {
+            if(q.Push(p)) {
+                ++p.counter;
+                ++n;
+            }
+        }
+        ops.fetch_add(n, std::memory_order_relaxed);
+    };
+
+    auto poper = [&]() {
+        unsigned long long n = 0;
+        Payload p;
+        while(!start.load(std::memory_order_acquire));
+        while(!stop.load(std::memory_order_relaxed)) {
+            if(q.Pop(&p)) {
+                ++n;
+            }
+        }
+        ops.fetch_add(n, std::memory_order_relaxed);
+    };
+
+    auto both = [&]() {
+        unsigned long long n = 0;
+        Payload p;
+        while(!start.load(std::memory_order_acquire));
+        while(!stop.load(std::memory_order_relaxed)) {
+            n += q.Push(p);
+            n += q.Pop(&p);
+        }
+        ops.fetch_add(n, std::memory_order_relaxed);
+    };
+
+    if(threads == 1) {
+        workers.emplace_back(both);
+    } else {
+        for(int i = 0; i < threads / 2; ++i) {
+            workers.emplace_back(pusher, (unsigned long)i);
+        }
+        for(int i = threads / 2; i < threads; ++i) {
+            workers.emplace_back(poper);
+        }
+    }
+
+    auto begin = std::chrono::steady_clock::now();
+    start.store(1, std::memory_order_release);
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+    stop.store(1, std::memory_order_relaxed);
+
+    for(size_t i = 0; i < workers.size(); ++i) {
+        workers[i].join();
+    }
+
+    q.Clear();
+
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    return ops.load() / elapsed;
+}
+
+template<typename FreeAllocateType>
+static void RunAllocateSeries(const char *name, double seconds, int max_threads) {
+    for(int threads = 1; threads <= max_threads; threads *= 2) {
+        double rate = RunAllocate<FreeAllocateType>(threads, seconds);
+        printf("%-12s threads=%-3d ops/sec=%.0f\n", name, threads, rate);
+        fflush(stdout);
+    }
+}
+
+template<typename Queue>
+static void RunQueueSeries(const char *name, double seconds, int max_threads) {
+    for(int threads = 1; threads <= max_threads; threads *= 2) {
+        double rate = RunQueue<Queue>(threads, seconds);
+        printf("%-12s threads=%-3d ops/sec=%.0f\n", name, threads, rate);
+        fflush(stdout);
+    }
+}
+
+int main(int argc, char **argv) {
+    double seconds = argc > 1 ? atof(argv[1]) : 1.0;
+    int max_threads = argc > 2 ? atoi(argv[2]) : 16;
+
+    printf("== FreeAllocate head, capacity=%lu ==\n", (unsigned long)BenchCapacity);
+    printf("versioned head lock free: %d, compact head lock free: %d\n",
+            (int)std::atomic<FreeAllocate<Payload>::ElementLink>().is_lock_free(),
+            (int)std::atomic<FreeAllocate<Payload, FreeAllocateCompactOptions>::ElementLink>().is_lock_free());
+    RunAllocateSeries<FreeAllocate<Payload>>("versioned", seconds, max_threads);
+    RunAllocateSeries<FreeAllocate<Payload, FreeAllocateCompactOptions>>("compact", seconds, max_threads);
+
+    printf("== LinkedQueue cursors, capacity=%lu ==\n", (unsigned long)BenchCapacity);
+    RunQueueSeries<LinkedQueue<Payload>>("versioned", seconds, max_threads);
+    RunQueueSeries<LinkedQueue<Payload, true, LinkedQueueCompactOptions>>("compact", seconds, max_threads);
+
+    return 0;
+}
@@ -0,0 +1,95 @@
+#include "free_allocate.h"
+
+#include <vector>
+#include <string>
+#include <thread>
+#include <memory>
+
+#include <signal.h>
+
+// magazine layer: every job holds a few nodes at a time, frees them in another order,
+// and after all jobs stop every node must still be allocatable
+
+struct UserData {
+    int x = 99999;
+    std::vector<std::string> vs {"this", "is", "a", "string", "vector"};
+};
+
+static std::atomic<int> stop = ATOMIC_VAR_INIT(0);
+
+static void sig_handler(int sig) {
+    stop.store(1, std::memory_order_relaxed);
+}
+
+int main() {
+    using FreeAllocateType = FreeAllocate<UserData, FreeAllocateMagazineOptions>;
+    using ElementFreeNode = FreeAllocateType::ElementFreeNode;
+
+    FreeAllocateType free_allocate(1000);
+
+    auto job = [&free_allocate](int index) {
+        size_t success = 0;
+        size_t failed = 0;
+        std::vector<ElementFreeNode *> holding;
+
+        printf("job %d start\n", index);
+
+        while(!stop.load(std::memory_order_relaxed)) {
+            size_t n = 1 + (success + failed) % 100;
+
+            for(size_t i = 0; i < n; ++i) {
+                ElementFreeNode *elem_node = free_allocate.Allocate();
+
+                if(elem_node) {
+                    free_allocate.ConstructAt(elem_node);
+                    holding.push_back(elem_node);
+                    ++success;
+                } else {
+                    ++failed;
+                }
+            }
+
+            while(!holding.empty()) {
+                ElementFreeNode *elem_node = holding[holding.size() / 2];
+                holding[holding.size() / 2] = holding.back();
+                holding.pop_back();
+
+                free_allocate.DestructAt(elem_node);
+                free_allocate.Deallocate(elem_node);
+            }
+        }
+
+        printf("job %d finish, success=%lu, failed=%lu\n", index, success, failed);
+    };
+
+    std::vector<std::thread> workers;
+
+    for(int i = 0; i < 20; ++i) {
+        workers.emplace_back(job, i);
+    }
+
+    signal(SIGINT, sig_handler);
+    signal(SIGTERM, sig_handler);
+
+    for(size_t i = 0; i < workers.size(); ++i) {
+        workers[i].join();
+    }
+
+    std::vector<ElementFreeNode *> all;
+
+    for(ElementFreeNode *elem_node; (elem_node = free_allocate.Allocate()) != nullptr; ) {
+        all.push_back(elem_node);
+    }
+
+    if(all.size() != free_allocate.GetCapacity()) {
+        fprintf(stderr, "node lost, allocatable=%lu, capacity=%lu\n", all.size(), free_allocate.GetCapacity());
+    } else {
+        printf("allocatable=%lu, capacity=%lu\n", all.size(), free_allocate.GetCapacity());
+    }
+
+    for(ElementFreeNode *elem_node: all) {
+        free_allocate.Deallocate(elem_node);
+    }
+
+    return 0;
+}
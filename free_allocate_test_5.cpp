@@ -0,0 +1,135 @@
+#include "free_allocate.h"
+
+#include <vector>
+#include <string>
+#include <thread>
+#include <chrono>
+
+#include <signal.h>
+
+// elastic pool: jobs hold bursts bigger than the initial slab so Allocate() grows,
+// main thread calls Shrink() meanwhile. after all jobs stop every node must still be
+// allocatable, and a final Shrink() must bring the pool back to its initial slab
+
+struct UserData {
+    int x = 99999;
+    std::vector<std::string> vs {"this", "is", "a", "string", "vector"};
+};
+
+static std::atomic<int> stop = ATOMIC_VAR_INIT(0);
+
+static void sig_handler(int sig) {
+    stop.store(1, std::memory_order_relaxed);
+}
+
+static constexpr size_t InitialCapacity = 1000;
+static constexpr size_t MaxCapacity = 20000;
+
+template<typename FreeAllocateType>
+static void job(FreeAllocateType *free_allocate, const char *name, int index) {
+    using ElementFreeNode = typename FreeAllocateType::ElementFreeNode;
+
+    size_t success = 0;
+    size_t failed = 0;
+    std::vector<ElementFreeNode *> holding;
+
+    printf("%s job %d start\n", name, index);
+
+    while(!stop.load(std::memory_order_relaxed)) {
+        // mostly small bursts, sometimes one that needs extra slabs
+        size_t n = (success + failed) % 7 == 0 ? 2000 : 1 + (success + failed) % 100;
+
+        for(size_t i = 0; i < n; ++i) {
+            ElementFreeNode *elem_node = free_allocate->Allocate();
+
+            if(elem_node) {
+                free_allocate->ConstructAt(elem_node);
+                holding.push_back(elem_node);
+                ++success;
+            } else {
+                ++failed;
+            }
+        }
+
+        while(!holding.empty()) {
+            ElementFreeNode *elem_node = holding[holding.size() / 2];
+            holding[holding.size() / 2] = holding.back();
+            holding.pop_back();
+
+            free_allocate->DestructAt(elem_node);
+            free_allocate->Deallocate(elem_node);
+        }
+    }
+
+    printf("%s job %d finish, success=%lu, failed=%lu\n", name, index, success, failed);
+}
+
+template<typename FreeAllocateType>
+static int check(FreeAllocateType *free_allocate, const char *name) {
+    using ElementFreeNode = typename FreeAllocateType::ElementFreeNode;
+
+    std::vector<ElementFreeNode *> all;
+    int ret = 0;
+
+    for(ElementFreeNode *elem_node; (elem_node = free_allocate->Allocate()) != nullptr; ) {
+        all.push_back(elem_node);
+    }
+
+    if(all.size() != free_allocate->GetCapacity() || all.size() != MaxCapacity) {
+        fprintf(stderr, "%s node lost, allocatable=%lu, capacity=%lu, max=%lu\n", name, all.size(), free_allocate->GetCapacity(), MaxCapacity);
+        ret = 1;
+    }
+
+    for(ElementFreeNode *elem_node: all) {
+        free_allocate->Deallocate(elem_node);
+    }
+
+    size_t released = free_allocate->Shrink();
+
+    if(free_allocate->GetCapacity() != InitialCapacity) {
+        fprintf(stderr, "%s shrink failed, released=%lu, capacity=%lu\n", name, released, free_allocate->GetCapacity());
+        ret = 1;
+    } else {
+        printf("%s allocatable=%lu, released=%lu, capacity=%lu\n", name, all.size(), released, free_allocate->GetCapacity());
+    }
+
+    return ret;
+}
+
+int main() {
+    using PlainType = FreeAllocate<UserData, FreeAllocateElasticOptions>;
+    using MagazineType = FreeAllocate<UserData, FreeAllocateElasticMagazineOptions>;
+
+    FreeAllocateGrowth growth;
+    growth.slab_capacity = 1000;
+    growth.max_capacity = MaxCapacity;
+
+    PlainType plain(InitialCapacity, MappedMemoryOptions(), growth);
+    MagazineType magazine(InitialCapacity, MappedMemoryOptions(), growth);
+
+    std::vector<std::thread> workers;
+
+    for(int i = 0; i < 8; ++i) {
+        workers.emplace_back(job<PlainType>, &plain, "plain", i);
+        workers.emplace_back(job<MagazineType>, &magazine, "magazine", i);
+    }
+
+    signal(SIGINT, sig_handler);
+    signal(SIGTERM, sig_handler);
+
+    size_t released = 0;
+
+    while(!stop.load(std::memory_order_relaxed)) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        released += plain.Shrink();
+        released += magazine.Shrink();
+    }
+
+    for(size_t i = 0; i < workers.size(); ++i) {
+        workers[i].join();
+    }
+
+    printf("released while running=%lu\n", released);
+
+    return check(&plain, "plain") | check(&magazine, "magazine");
+}
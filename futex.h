@@ -0,0 +1,28 @@
+#ifndef __FUTEX_H__
+#define __FUTEX_H__
+
+#include <atomic>
+
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+// thin wrappers of the futex syscall on a process private 32-bit word.
+// std::atomic<uint32_t> has the same layout as uint32_t on every supported target.
+
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t));
+
+// sleep while *word == expected, at most timeout (nullptr: no limit).
+// return on wake up, timeout, signal, or if *word != expected already
+static inline void FutexWait(std::atomic<uint32_t> *word, uint32_t expected, const struct timespec *timeout) {
+    syscall(SYS_futex, (uint32_t *)word, FUTEX_WAIT_PRIVATE, expected, timeout, nullptr, 0);
+}
+
+// wake at most count threads sleeping on word
+static inline void FutexWake(std::atomic<uint32_t> *word, int count) {
+    syscall(SYS_futex, (uint32_t *)word, FUTEX_WAKE_PRIVATE, count, nullptr, nullptr, 0);
+}
+
+#endif
@@ -0,0 +1,180 @@
+#ifndef __INTRUSIVE_QUEUE_H__
+#define __INTRUSIVE_QUEUE_H__
+
+#include "cache_line.h"
+
+#include <atomic>
+#include <thread>
+#include <type_traits>
+
+#include <stddef.h>
+#include <assert.h>
+#include <stdio.h>
+
+#define ASSERT_LOG(cond, fmt, ...) \
+    if(!(cond)) {\
+        fprintf(stderr, "[%s:%d:%s] " fmt "\n", __FILE__, __LINE__, __FUNCTION__, ##__VA_ARGS__);\
+        assert(0);\
+    }
+
+// the hook lives in the caller's object: struct Message : IntrusiveQueueHook { ... }.
+// an object is in at most one queue at a time, and is owned by the queue from Push()
+// until Pop() hands the same pointer back
+struct IntrusiveQueueHook {
+    std::atomic<IntrusiveQueueHook *> intrusive_next = ATOMIC_VAR_INIT(nullptr);
+};
+
+// unbounded queue of caller owned objects, nothing is allocated, copied or moved.
+// Push() is one exchange on the tail, so any number of writers is wait free. Pop() is
+// for one reader thread. with MultiReader = true several threads may call Pop(), but
+// they take a spin lock on the head: a reader descheduled while holding it stalls
+// every other reader, so multi-reader Pop() is blocking, unlike the other queues.
+// the lock keeps Pop() free of ABA without versions, lifetimes or reclamation of the
+// hooks. a stub hook stands for "empty node", so every pushed object can be handed back
+template<typename ElementType, bool MultiReader = false>
+class IntrusiveQueue {
+    static_assert(std::is_base_of<IntrusiveQueueHook, ElementType>::value, "ElementType must derive from IntrusiveQueueHook");
+
+public:
+    IntrusiveQueue() {
+        m_read = &m_stub;
+        m_write.store(&m_stub, std::memory_order_relaxed);
+    }
+
+    ~IntrusiveQueue() {
+        // objects belong to the caller, nothing to release
+        ASSERT_LOG(Empty(), "queue is NOT cleared. call Clear() or ClearF() before \"%s\"", __PRETTY_FUNCTION__);
+    }
+
+    // elem must not be in any queue
+    void Push(ElementType *elem) {
+        PushHook(elem);
+    }
+
+    // f(ElementType *elem), elem is still owned by the queue while f runs
+    template<typename Function>
+    bool PopF(Function f) {
+        ElementType *elem = Pop();
+
+        if(!elem) {
+            return false;
+        }
+
+        f(elem);
+
+        return true;
+    }
+
+    // return the object pushed earliest, nullptr if the queue is empty. a Push() that has
+    // swapped the tail but not yet linked its object is not seen, nor anything after it.
+    // MultiReader: takes the read lock, see the class comment
+    ElementType *Pop() {
+        if constexpr (MultiReader) {
+            LockRead();
+        }
+
+        IntrusiveQueueHook *hook = PopHook();
+
+        if constexpr (MultiReader) {
+            m_reading.store(false, std::memory_order_release);
+        }
+
+        return static_cast<ElementType *>(hook);
+    }
+
+    // a hint only, for a reader: Push() may be halfway
+    bool Empty() const {
+        return m_write.load(std::memory_order_acquire) == &m_stub;
+    }
+
+    template<typename Function>
+    // f is same in PopF()
+    void ClearF(Function f) {
+        while(PopF(f));
+    }
+
+    void Clear() {
+        while(Pop());
+    }
+
+private:
+    IntrusiveQueue(const IntrusiveQueue &);
+    IntrusiveQueue(IntrusiveQueue &&);
+    IntrusiveQueue &operator=(const IntrusiveQueue &);
+    IntrusiveQueue &operator=(IntrusiveQueue &&);
+
+    void PushHook(IntrusiveQueueHook *hook) {
+        hook->intrusive_next.store(nullptr, std::memory_order_relaxed);
+
+        // from here on hook is the tail, the list is linked up to it right after.
+        // a reader meeting the gap in between treats the rest as not pushed yet
+        IntrusiveQueueHook *prev = m_write.exchange(hook, std::memory_order_acq_rel);
+        prev->intrusive_next.store(hook, std::memory_order_release);
+    }
+
+    // called by the only reader
+    IntrusiveQueueHook *PopHook() {
+        IntrusiveQueueHook *read = m_read;
+        IntrusiveQueueHook *read_next = read->intrusive_next.load(std::memory_order_acquire);
+
+        if(read == &m_stub) {
+            // skip the stub, it is pushed again when the last object goes
+            if(!read_next) {
+                // queue is empty
+                return nullptr;
+            }
+
+            m_read = read_next;
+            read = read_next;
+            read_next = read->intrusive_next.load(std::memory_order_acquire);
+        }
+
+        if(read_next) {
+            m_read = read_next;
+            return read;
+        }
+
+        if(read != m_write.load(std::memory_order_acquire)) {
+            // Push() NOT complete, read is not the tail but has no successor yet
+            return nullptr;
+        }
+
+        // read is the last object, put the stub behind it so read can leave
+        PushHook(&m_stub);
+
+        read_next = read->intrusive_next.load(std::memory_order_acquire);
+
+        if(read_next) {
+            m_read = read_next;
+            return read;
+        }
+
+        // another Push() got in between, its link is not there yet
+        return nullptr;
+    }
+
+    void LockRead() {
+        for(int i = 0; ; ++i) {
+            if(!m_reading.load(std::memory_order_relaxed) && !m_reading.exchange(true, std::memory_order_acquire)) {
+                return;
+            }
+
+            if(i % 64 == 63) {
+                // the reader holding the flag may be descheduled
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    alignas(CacheLineSize) std::atomic<IntrusiveQueueHook *> m_write;
+
+    // owned by the reader, with MultiReader by whoever holds m_reading
+    alignas(CacheLineSize) IntrusiveQueueHook *m_read;
+    std::atomic<bool> m_reading = ATOMIC_VAR_INIT(false);
+
+    alignas(CacheLineSize) IntrusiveQueueHook m_stub;
+};
+
+#undef ASSERT_LOG
+
+#endif
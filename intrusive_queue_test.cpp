@@ -0,0 +1,161 @@
+#include "intrusive_queue.h"
+
+#include <vector>
+#include <thread>
+#include <memory>
+
+#include <string.h>
+
+#include <signal.h>
+
+// caller owned messages: pushers take messages from their own free list, poppers check
+// Pop() returns the very object pushed (self), per-producer order and the payload, then
+// hand it back to its producer. a multi reader and a single reader queue run side by side
+
+struct Message : IntrusiveQueueHook {
+    Message *self = this;
+    unsigned long producer = 0;
+    unsigned long counter = 0;
+    char payload[256];
+};
+
+static constexpr int Pushers = 2;
+static constexpr int Popers = 3;
+static constexpr size_t MessagesPerPusher = 1000;
+
+static std::atomic<int> stop = ATOMIC_VAR_INIT(0);
+
+static void sig_handler(int sig) {
+    stop.store(1, std::memory_order_relaxed);
+}
+
+template<bool MultiReader>
+static int run(const char *name, int popers) {
+    IntrusiveQueue<Message, MultiReader> q;
+
+    // messages go back to their producer through its own queue
+    std::vector<Message> messages(Pushers * MessagesPerPusher);
+    std::vector<std::unique_ptr<IntrusiveQueue<Message, true>>> free_lists;
+
+    for(int i = 0; i < Pushers; ++i) {
+        free_lists.emplace_back(new IntrusiveQueue<Message, true>());
+
+        for(size_t j = 0; j < MessagesPerPusher; ++j) {
+            Message *m = &messages[i * MessagesPerPusher + j];
+            m->producer = i;
+            free_lists[i]->Push(m);
+        }
+    }
+
+    std::atomic<unsigned long long> push_success(0);
+    std::atomic<unsigned long long> pop_success(0);
+    std::atomic<unsigned long long> errors(0);
+
+    std::vector<std::thread> pushers;
+    std::vector<std::thread> readers;
+
+    for(int i = 0; i < Pushers; ++i) {
+        pushers.emplace_back([&, i]() {
+                unsigned long counter = 0;
+
+                while(!stop.load(std::memory_order_relaxed)) {
+                    Message *m = free_lists[i]->Pop();
+
+                    if(!m) {
+                        std::this_thread::yield();
+                        continue;
+                    }
+
+                    m->counter = counter++;
+                    memset(m->payload, (int)(m->counter & 0xff), sizeof(m->payload));
+
+                    q.Push(m);
+                    push_success.fetch_add(1u, std::memory_order_relaxed);
+                }
+                });
+    }
+
+    auto check = [&errors](std::vector<unsigned long> &next, Message *m) {
+        bool ok = m->self == m && m->producer < (unsigned long)Pushers && m->counter >= next[m->producer];
+
+        for(size_t j = 0; ok && j < sizeof(m->payload); ++j) {
+            ok = m->payload[j] == (char)(m->counter & 0xff);
+        }
+
+        if(!ok) {
+            errors.fetch_add(1u, std::memory_order_relaxed);
+        } else {
+            next[m->producer] = m->counter + 1u;
+        }
+    };
+
+    for(int i = 0; i < popers; ++i) {
+        readers.emplace_back([&]() {
+                std::vector<unsigned long> next(Pushers, 0);
+
+                while(!stop.load(std::memory_order_relaxed)) {
+                    Message *m = q.Pop();
+
+                    if(m) {
+                        check(next, m);
+                        pop_success.fetch_add(1u, std::memory_order_relaxed);
+                        free_lists[m->producer]->Push(m);
+                    }
+                }
+                });
+    }
+
+    for(size_t i = 0; i < pushers.size(); ++i) {
+        pushers[i].join();
+    }
+
+    for(size_t i = 0; i < readers.size(); ++i) {
+        readers[i].join();
+    }
+
+    unsigned long long left = 0;
+
+    q.ClearF([&](Message *m) {
+            free_lists[m->producer]->Push(m);
+            ++left;
+            });
+
+    // every message is back home
+    size_t home = 0;
+
+    for(int i = 0; i < Pushers; ++i) {
+        free_lists[i]->ClearF([&home, i, &errors](Message *m) {
+                if(m->producer != (unsigned long)i) {
+                    errors.fetch_add(1u, std::memory_order_relaxed);
+                }
+
+                ++home;
+                });
+    }
+
+    printf("%s push_success=%llu, pop_success=%llu, left=%llu, home=%lu, errors=%llu\n",
+            name, push_success.load(), pop_success.load(), left, home, errors.load());
+
+    if(push_success.load() != pop_success.load() + left || home != messages.size() || errors.load()) {
+        fprintf(stderr, "%s FAILED\n", name);
+        return 1;
+    }
+
+    return 0;
+}
+
+int main() {
+    signal(SIGINT, sig_handler);
+    signal(SIGTERM, sig_handler);
+
+    int multi_ret = 0;
+
+    std::thread t([&multi_ret]() {
+            multi_ret = run<true>("multi_reader", Popers);
+            });
+
+    int single_ret = run<false>("single_reader", 1);
+    t.join();
+
+    return multi_ret | single_ret;
+}
@@ -0,0 +1,273 @@
+#include "fixed_queue.h"
+#include "linked_queue.h"
+#include "free_allocate.h"
+#include "latency_histogram.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+#include <memory>
+#include <chrono>
+
+// usage: latency_bench.out [seconds_per_run] [max_threads] [csv|json]
+//
+// sweeps producer/consumer counts (powers of two, producers + consumers <= max_threads),
+// payload sizes and capacities over FixedQueue, LinkedQueue and FixedQueue of
+// FreeAllocate nodes (the pattern of free_allocate_test_3.cpp). producers push as fast
+// as they can, every element carries its push time and consumers record push-to-pop
+// latency, so a saturated queue's latency includes the wait behind queued elements.
+// one line per run: csv with a header line, or json with one object per line.
+// ops_per_sec counts popped elements.
+
+static constexpr size_t PayloadSizes[] = {16, 64, 256};
+static constexpr size_t Capacities[] = {1024, 65536};
+
+static uint64_t NowNs() {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+template<size_t Size>
+struct Payload {
+    uint64_t timestamp = 0;
+    char data[Size - sizeof(uint64_t)];
+};
+
+// adapters, all with bool Push(uint64_t timestamp) and bool Pop(uint64_t *timestamp)
+
+template<size_t Size>
+class FixedQueueBench {
+public:
+    static constexpr const char *Name = "fixed_queue";
+
+    explicit FixedQueueBench(size_t capacity) : m_queue(capacity) {}
+
+    bool Push(uint64_t timestamp) {
+        Payload<Size> p;
+        p.timestamp = timestamp;
+        return m_queue.Push(p);
+    }
+
+    bool Pop(uint64_t *timestamp) {
+        Payload<Size> p;
+
+        if(!m_queue.Pop(&p)) {
+            return false;
+        }
+
+        *timestamp = p.timestamp;
+        return true;
+    }
+
+private:
+    FixedQueue<Payload<Size>, FixedQueueDynamicCapacity> m_queue;
+};
+
+template<size_t Size>
+class LinkedQueueBench {
+public:
+    static constexpr const char *Name = "linked_queue";
+
+    explicit LinkedQueueBench(size_t capacity) : m_queue(capacity) {}
+
+    ~LinkedQueueBench() {
+        m_queue.Clear();
+    }
+
+    bool Push(uint64_t timestamp) {
+        return m_queue.PushF([timestamp](Payload<Size> *elem) {
+                new (elem) Payload<Size>();
+                elem->timestamp = timestamp;
+                });
+    }
+
+    bool Pop(uint64_t *timestamp) {
+        return m_queue.ConsumeInPlace([timestamp](Payload<Size> &elem) {
+                *timestamp = elem.timestamp;
+                });
+    }
+
+private:
+    LinkedQueue<Payload<Size>> m_queue;
+};
+
+// elements live in a FreeAllocate pool, only node pointers go through the queue
+template<size_t Size>
+class FreeAllocateQueueBench {
+    using FreeAllocateType = FreeAllocate<Payload<Size>>;
+    using ElementFreeNode = typename FreeAllocateType::ElementFreeNode;
+
+public:
+    static constexpr const char *Name = "fixed_queue_free_allocate";
+
+    explicit FreeAllocateQueueBench(size_t capacity) : m_queue(capacity), m_free_allocate(capacity) {}
+
+    ~FreeAllocateQueueBench() {
+        uint64_t timestamp;
+        while(Pop(&timestamp));
+    }
+
+    bool Push(uint64_t timestamp) {
+        ElementFreeNode *elem_node = m_free_allocate.Allocate();
+
+        if(!elem_node) {
+            return false;
+        }
+
+        m_free_allocate.ConstructAt(elem_node);
+        m_free_allocate.AccessElementPointerAt(elem_node)->timestamp = timestamp;
+
+        // the pool holds no more nodes than the queue, so this never fails
+        return m_queue.Push(elem_node);
+    }
+
+    bool Pop(uint64_t *timestamp) {
+        ElementFreeNode *elem_node;
+
+        if(!m_queue.Pop(&elem_node)) {
+            return false;
+        }
+
+        *timestamp = m_free_allocate.AccessElementPointerAt(elem_node)->timestamp;
+        m_free_allocate.DestructAt(elem_node);
+        m_free_allocate.Deallocate(elem_node);
+        return true;
+    }
+
+private:
+    FixedQueue<ElementFreeNode *, FixedQueueDynamicCapacity> m_queue;
+    FreeAllocateType m_free_allocate;
+};
+
+struct RunResult {
+    double ops_per_sec;
+    LatencyHistogram<> latency;
+};
+
+template<typename Bench>
+static RunResult Run(size_t capacity, int producers, int consumers, double seconds) {
+    std::unique_ptr<Bench> bench_p = std::make_unique<Bench>(capacity);
+    Bench &bench = *bench_p;
+
+    std::atomic<int> start = ATOMIC_VAR_INIT(0);
+    std::atomic<int> stop = ATOMIC_VAR_INIT(0);
+    std::atomic<unsigned long long> pops = ATOMIC_VAR_INIT(0);
+
+    std::vector<LatencyHistogram<>> histograms(consumers);
+    std::vector<std::thread> workers;
+
+    for(int i = 0; i < producers; ++i) {
+        workers.emplace_back([&]() {
+                while(!start.load(std::memory_order_acquire));
+                while(!stop.load(std::memory_order_relaxed)) {
+                    bench.Push(NowNs());
+                }
+                });
+    }
+
+    for(int i = 0; i < consumers; ++i) {
+        workers.emplace_back([&, i]() {
+                LatencyHistogram<> &histogram = histograms[i];
+                unsigned long long n = 0;
+                uint64_t timestamp;
+
+                while(!start.load(std::memory_order_acquire));
+                while(!stop.load(std::memory_order_relaxed)) {
+                    if(bench.Pop(&timestamp)) {
+                        uint64_t now = NowNs();
+                        histogram.Record(now > timestamp ? now - timestamp : 0);
+                        ++n;
+                    }
+                }
+                pops.fetch_add(n, std::memory_order_relaxed);
+                });
+    }
+
+    auto begin = std::chrono::steady_clock::now();
+    start.store(1, std::memory_order_release);
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+    stop.store(1, std::memory_order_relaxed);
+
+    for(size_t i = 0; i < workers.size(); ++i) {
+        workers[i].join();
+    }
+
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    RunResult result;
+    result.ops_per_sec = pops.load() / elapsed;
+
+    for(int i = 0; i < consumers; ++i) {
+        result.latency.Merge(histograms[i]);
+    }
+
+    return result;
+}
+
+static bool json = false;
+
+static void PrintHeader() {
+    if(!json) {
+        printf("structure,producers,consumers,payload,capacity,ops_per_sec,mean_ns,p50_ns,p99_ns,p999_ns,max_ns\n");
+    }
+}
+
+static void PrintResult(const char *name, int producers, int consumers, size_t payload, size_t capacity, const RunResult &r) {
+    const LatencyHistogram<> &h = r.latency;
+
+    if(json) {
+        printf("{\"structure\":\"%s\",\"producers\":%d,\"consumers\":%d,\"payload\":%lu,\"capacity\":%lu,"
+                "\"ops_per_sec\":%.0f,\"mean_ns\":%.0f,\"p50_ns\":%lu,\"p99_ns\":%lu,\"p999_ns\":%lu,\"max_ns\":%lu}\n",
+                name, producers, consumers, (unsigned long)payload, (unsigned long)capacity, r.ops_per_sec, h.GetMean(),
+                (unsigned long)h.Percentile(50.0), (unsigned long)h.Percentile(99.0), (unsigned long)h.Percentile(99.9),
+                (unsigned long)h.GetMax());
+    } else {
+        printf("%s,%d,%d,%lu,%lu,%.0f,%.0f,%lu,%lu,%lu,%lu\n",
+                name, producers, consumers, (unsigned long)payload, (unsigned long)capacity, r.ops_per_sec, h.GetMean(),
+                (unsigned long)h.Percentile(50.0), (unsigned long)h.Percentile(99.0), (unsigned long)h.Percentile(99.9),
+                (unsigned long)h.GetMax());
+    }
+
+    fflush(stdout);
+}
+
+template<template<size_t> class Bench, size_t Size>
+static void RunSweep(double seconds, int max_threads) {
+    for(size_t capacity : Capacities) {
+        for(int producers = 1; producers < max_threads; producers *= 2) {
+            for(int consumers = 1; producers + consumers <= max_threads; consumers *= 2) {
+                RunResult r = Run<Bench<Size>>(capacity, producers, consumers, seconds);
+                PrintResult(Bench<Size>::Name, producers, consumers, Size, capacity, r);
+            }
+        }
+    }
+}
+
+template<template<size_t> class Bench>
+static void RunStructure(double seconds, int max_threads) {
+    static_assert(sizeof(PayloadSizes) / sizeof(PayloadSizes[0]) == 3, "keep RunStructure in sync with PayloadSizes");
+
+    RunSweep<Bench, PayloadSizes[0]>(seconds, max_threads);
+    RunSweep<Bench, PayloadSizes[1]>(seconds, max_threads);
+    RunSweep<Bench, PayloadSizes[2]>(seconds, max_threads);
+}
+
+int main(int argc, char **argv) {
+    double seconds = argc > 1 ? atof(argv[1]) : 0.5;
+    int max_threads = argc > 2 ? atoi(argv[2]) : 4;
+    json = argc > 3 && strcmp(argv[3], "json") == 0;
+
+    if(max_threads < 2) {
+        max_threads = 2;
+    }
+
+    PrintHeader();
+
+    RunStructure<FixedQueueBench>(seconds, max_threads);
+    RunStructure<LinkedQueueBench>(seconds, max_threads);
+    RunStructure<FreeAllocateQueueBench>(seconds, max_threads);
+
+    return 0;
+}
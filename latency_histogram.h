@@ -0,0 +1,117 @@
+#ifndef __LATENCY_HISTOGRAM_H__
+#define __LATENCY_HISTOGRAM_H__
+
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+
+// log-linear buckets in the manner of HdrHistogram: values below 2^SubBucketBits are
+// counted exactly, each power of two above is split into 2^SubBucketBits buckets, so
+// a reported value is at most 2^-SubBucketBits above the recorded one. values from
+// 2^MaxBits on fall into the last bucket. one histogram per thread, Merge() at the end
+template<unsigned SubBucketBits = 5, unsigned MaxBits = 40>
+class LatencyHistogram {
+    static_assert(SubBucketBits < MaxBits && MaxBits < 64, "bad bucket bits");
+
+    static constexpr size_t SubBuckets = (size_t)1 << SubBucketBits;
+    static constexpr size_t BucketCount = (MaxBits - SubBucketBits + 1u) * SubBuckets;
+
+public:
+    LatencyHistogram() : m_counts(BucketCount, 0) {}
+
+    void Record(uint64_t value) {
+        ++m_counts[IndexOf(value)];
+        ++m_total;
+        m_sum += value;
+
+        if(value > m_max) {
+            m_max = value;
+        }
+    }
+
+    void Merge(const LatencyHistogram &other) {
+        for(size_t i = 0; i < BucketCount; ++i) {
+            m_counts[i] += other.m_counts[i];
+        }
+
+        m_total += other.m_total;
+        m_sum += other.m_sum;
+
+        if(other.m_max > m_max) {
+            m_max = other.m_max;
+        }
+    }
+
+    // smallest bucket value that percentile (0, 100] of the records do not exceed
+    uint64_t Percentile(double percentile) const {
+        if(!m_total) {
+            return 0;
+        }
+
+        uint64_t rank = (uint64_t)(percentile / 100.0 * m_total + 0.5);
+        uint64_t seen = 0;
+
+        if(!rank) {
+            rank = 1;
+        }
+
+        for(size_t i = 0; i < BucketCount; ++i) {
+            seen += m_counts[i];
+
+            if(seen >= rank) {
+                uint64_t value = ValueAt(i);
+                return value < m_max ? value : m_max;
+            }
+        }
+
+        return m_max;
+    }
+
+    uint64_t GetCount() const {
+        return m_total;
+    }
+
+    uint64_t GetMax() const {
+        return m_max;
+    }
+
+    double GetMean() const {
+        return m_total ? (double)m_sum / m_total : 0.0;
+    }
+
+private:
+    static size_t IndexOf(uint64_t value) {
+        if(value >= ((uint64_t)1 << MaxBits)) {
+            value = ((uint64_t)1 << MaxBits) - 1u;
+        }
+
+        if(value < SubBuckets) {
+            return (size_t)value;
+        }
+
+        // value >> shift keeps the top SubBucketBits + 1 bits, in [SubBuckets, 2 * SubBuckets)
+        unsigned shift = 63u - __builtin_clzll(value) - SubBucketBits;
+
+        return (shift + 1u) * SubBuckets + (size_t)(value >> shift) - SubBuckets;
+    }
+
+    // highest value counted in bucket index
+    static uint64_t ValueAt(size_t index) {
+        if(index < SubBuckets) {
+            return index;
+        }
+
+        unsigned shift = (unsigned)(index / SubBuckets) - 1u;
+        uint64_t top = index % SubBuckets + SubBuckets;
+
+        return ((top + 1u) << shift) - 1u;
+    }
+
+    std::vector<uint64_t> m_counts;
+    uint64_t m_total = 0;
+    uint64_t m_sum = 0;
+    uint64_t m_max = 0;
+};
+
+#endif
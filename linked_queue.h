@@ -2,9 +2,14 @@
 #define __LINKED_QUEUE_H__
 
 #include "free_allocate.h"
+#include "epoch_reclaim.h"
+#include "backoff.h"
 
 #include <atomic>
 #include <thread>
+#include <new>
+#include <utility>
+#include <iterator>
 
 #include <stddef.h>
 #include <assert.h>
@@ -16,35 +21,111 @@
         assert(0);\
     }
 
-template<typename ElementType, bool MultiReader = true>
+struct LinkedQueueDefaultOptions {
+    // options of the FreeAllocate holding the queue nodes
+    using AllocateOptions = FreeAllocateDefaultOptions;
+    // recycle popped nodes through EpochReclaim instead of right away, so nodes can go
+    // back to the heap or to a shrinking pool safely
+    static constexpr bool Reclaim = false;
+    // capacity nodes are preallocated, more come from operator new and go back to the
+    // heap through EpochReclaim. implies Reclaim
+    static constexpr bool Unbounded = false;
+    using ReclaimOptions = EpochReclaimDefaultOptions;
+    // QueueStats<> counts operations, full/empty returns and lost CAS on the tail link
+    // and m_read. node pool counters come from AllocateOptions::Stats, see GetStats()
+    using Stats = QueueNoStats;
+    // what a lost CAS on the tail link or on m_read does before the next try, see backoff.h.
+    // the node pool has its own, AllocateOptions::Backoff
+    using Backoff = BackoffDefault;
+};
+
+struct LinkedQueueMagazineOptions : LinkedQueueDefaultOptions {
+    using AllocateOptions = FreeAllocateMagazineOptions;
+};
+
+// 64 bit CAS on cursors and links instead of cmpxchg16b, see FreeAllocateDefaultOptions::CompactHead
+struct LinkedQueueCompactOptions : LinkedQueueDefaultOptions {
+    using AllocateOptions = FreeAllocateCompactOptions;
+};
+
+struct LinkedQueueElasticOptions : LinkedQueueDefaultOptions {
+    using AllocateOptions = FreeAllocateElasticOptions;
+};
+
+struct LinkedQueueReclaimOptions : LinkedQueueDefaultOptions {
+    static constexpr bool Reclaim = true;
+};
+
+struct LinkedQueueUnboundedOptions : LinkedQueueDefaultOptions {
+    static constexpr bool Unbounded = true;
+};
+
+struct LinkedQueueStatsOptions : LinkedQueueDefaultOptions {
+    using AllocateOptions = FreeAllocateStatsOptions;
+    using Stats = QueueStats<>;
+};
+
+template<typename ElementType, bool MultiReader = true, typename Options = LinkedQueueDefaultOptions>
 class LinkedQueue {
+    static constexpr bool ReclaimEnabled = Options::Reclaim || Options::Unbounded;
+
+    static_assert(!Options::Unbounded || !Options::AllocateOptions::CompactHead, "heap nodes have no pool index");
+
 public:
 
-    LinkedQueue(size_t capacity) : free_allocate(capacity + 1u), m_capacity(capacity) {
+    // nodes come from mapped slabs of FreeAllocate, see MappedMemoryOptions for huge pages.
+    // with elastic AllocateOptions the queue grows by growth.slab_capacity elements when
+    // it is full, up to growth.max_capacity elements
+    LinkedQueue(size_t capacity, const MappedMemoryOptions &memory_options = MappedMemoryOptions(),
+            const FreeAllocateGrowth &growth = FreeAllocateGrowth()) :
+        free_allocate(capacity + 1u, memory_options, FreeAllocateGrowth{growth.slab_capacity, growth.max_capacity + 1u}) {
         // at lease one node as "empty node"
         assert(capacity < capacity + 1u);
 
         ElementFreeNode *empty_node = free_allocate.Allocate();
+        ASSERT_LOG(empty_node, "no node for \"empty node\"");
         free_allocate.AccessElementPointerAt(empty_node)->lifetime.store(ELEMENT_LIFETIME_DESTRUCTED, std::memory_order_relaxed);
-        ElementVersionPointer next_elem_node = empty_node->next_node.load(std::memory_order_relaxed);
-        empty_node->next_node.store({nullptr, next_elem_node.version + 1u}, std::memory_order_relaxed);
+        ElementLink next_elem_node = empty_node->next_node.load(std::memory_order_relaxed);
+        empty_node->next_node.store(free_allocate.MakeLink(nullptr, free_allocate.LinkVersion(next_elem_node) + 1u), std::memory_order_relaxed);
 
-        m_read.store({empty_node, 0}, std::memory_order_relaxed);
-        m_write.store({empty_node, 0});
+        m_read.store(free_allocate.MakeLink(empty_node, 0), std::memory_order_relaxed);
+        m_write.store(free_allocate.MakeLink(empty_node, 0));
     }
 
     ~LinkedQueue() {
         // Clear();
 
         // deallocate "empty node"
-        ElementVersionPointer read = m_read.load(std::memory_order_relaxed);
-        ElementVersionPointer write = m_write.load(std::memory_order_relaxed);
-        ASSERT_LOG(read.pointer == write.pointer, "queue is NOT cleared. call Clear() or ClearF() before \"%s\"", __PRETTY_FUNCTION__);
-        free_allocate.Deallocate(read.pointer);
+        ElementFreeNode *read = free_allocate.LinkPointer(m_read.load(std::memory_order_relaxed));
+        ElementFreeNode *write = free_allocate.LinkPointer(m_write.load(std::memory_order_relaxed));
+        ASSERT_LOG(read == write, "queue is NOT cleared. call Clear() or ClearF() before \"%s\"", __PRETTY_FUNCTION__);
+        ASSERT_LOG(read, "\"empty node\" is lost");
+        FreeNode(read);
     }
 
+    // preallocated capacity in Unbounded mode
     size_t GetCapacity() const {
-        return m_capacity;
+        // one node is always the "empty node"
+        return free_allocate.GetCapacity() - 1u;
+    }
+
+    // queue counters merged with those of the node pool, all zero unless Options::Stats
+    // or AllocateOptions::Stats count
+    QueueStatsSnapshot GetStats() const {
+        QueueStatsSnapshot snapshot = m_stats.Snapshot();
+        snapshot += free_allocate.GetStats();
+
+        return snapshot;
+    }
+
+    // free retired nodes that are safe by now, then return unused extra slabs to the OS,
+    // see FreeAllocate::Shrink()
+    size_t Shrink() {
+        if constexpr (ReclaimEnabled) {
+            m_reclaim.Collect();
+        }
+
+        return free_allocate.Shrink();
     }
 
     template<typename ... Args>
@@ -57,131 +138,246 @@ public:
     template<typename Function>
     // f(ElementType *elem), elem is not constructed
     bool PushF(Function f) {
-        ElementFreeNode *elem_node = free_allocate.Allocate();
+        ElementFreeNode *elem_node = AllocateNode();
 
         if(!elem_node) {
             // pool has been used up
+            m_stats.Add(QUEUE_STAT_FULL);
             return false;
         }
 
-        ElementContainer *elem_container = free_allocate.AccessElementPointerAt(elem_node);
-        f( (ElementType *)elem_container->buffer );
-        elem_container->lifetime.store(ELEMENT_LIFETIME_CONSTRUCTED, std::memory_order_relaxed);
+        PrepareNode(elem_node, f);
 
-        ElementVersionPointer next_elem_node = elem_node->next_node.load(std::memory_order_relaxed);
-        elem_node->next_node.store({nullptr, next_elem_node.version + 1u}, std::memory_order_relaxed);
+        [[maybe_unused]] ReclaimGuard guard = Pin();
+        LinkChain(elem_node, elem_node);
+        m_stats.Add(QUEUE_STAT_PUSH);
 
-        ElementVersionPointer write;
-        ElementVersionPointer write_next;
-        for(;;) {
-            write = m_write.load(std::memory_order_relaxed);
-            write_next = write.pointer->next_node.load(std::memory_order_relaxed);
+        return true;
+    }
 
-            // for multiple Push(), only one operation's write_next.pointer is nullptr.
-            // other Push() must wait until write_next.pointer is nullptr.
-            if(!write_next.pointer) {
-                // for multiple Push(), once this CAS operation is successful,
-                // other Push() will meet write_next.pointer NOT nullptr
-                if(write.pointer->next_node.compare_exchange_strong(write_next, {elem_node, write_next.version + 1u})) {
-                    m_write.compare_exchange_strong(write, {elem_node, write.version + 1u});
-                    break;
-                }
+    // push elements of [first, last). nodes are linked privately and spliced onto the
+    // tail with one CAS. return how many elements (from first) were pushed, fewer than
+    // requested if the pool runs out
+    template<typename Iterator>
+    size_t PushBatch(Iterator first, Iterator last) {
+        return PushBatchF((size_t)std::distance(first, last), [&first](size_t i, ElementType *elem) {
+                new (elem) ElementType(*first);
+                ++first;
+                });
+    }
+
+    // f(size_t i, ElementType *elem) constructs the i-th of n elements, i counts up from 0
+    template<typename Function>
+    size_t PushBatchF(size_t n, Function f) {
+        ElementFreeNode *first_node = nullptr;
+        ElementFreeNode *last_node = nullptr;
+        size_t count = 0;
+
+        auto construct = [&f, &count](ElementType *elem) {
+            f(count, elem);
+        };
+
+        for(; count < n; ++count) {
+            ElementFreeNode *elem_node = AllocateNode();
+
+            if(!elem_node) {
+                // pool has been used up
+                break;
+            }
+
+            PrepareNode(elem_node, construct);
+
+            if(last_node) {
+                // still private, the CAS in LinkChain() publishes the chain
+                ElementLink next_elem_node = last_node->next_node.load(std::memory_order_relaxed);
+                last_node->next_node.store(free_allocate.MakeLink(elem_node, free_allocate.LinkVersion(next_elem_node) + 1u), std::memory_order_relaxed);
             } else {
-                // help change m_write to its right value
-                // we can also wait last success Push() to complete this operation
-                m_write.compare_exchange_strong(write, {write_next.pointer, write.version + 1u});
+                first_node = elem_node;
             }
+
+            last_node = elem_node;
         }
 
-        return true;
+        if(count) {
+            [[maybe_unused]] ReclaimGuard guard = Pin();
+            LinkChain(first_node, last_node);
+            m_stats.Add(QUEUE_STAT_PUSH, count);
+        } else {
+            m_stats.Add(QUEUE_STAT_FULL);
+        }
+
+        return count;
     }
 
     template<typename OutType>
     bool Pop(OutType *out) {
         return PopF([out](ElementType *elem) {
                 if(out) {
-                    *out = *elem;
+                    *out = std::move(*elem);
                 }
 
                 elem->~ElementType();
                 });
     }
 
+    // f(ElementType &elem) works on the element in its node, no output temporary.
+    // the element is destructed after f returns
+    template<typename Function>
+    bool ConsumeInPlace(Function f) {
+        return PopF([&f](ElementType *elem) {
+                f(*elem);
+
+                elem->~ElementType();
+                });
+    }
+
     template<typename Function>
     // f(ElementType *elem), corresponding to PushF()
     bool PopF(Function f) {
-        ElementVersionPointer write;
-        ElementVersionPointer read;
-        ElementVersionPointer read_next;
+        // the guard also keeps read_next_node alive while f runs
+        ReclaimGuard guard = Pin();
+        ElementLink write;
+        ElementLink read;
+        ElementFreeNode *read_node;
+        typename Options::Backoff backoff;
+        ElementFreeNode *read_next_node;
 
         for(;;) {
+            // m_read first: m_write read after it is never behind read_node
+            read = m_read.load(std::memory_order_acquire);
             write = m_write.load(std::memory_order_acquire);
-            read = m_read.load(std::memory_order_relaxed);
+            read_node = free_allocate.LinkPointer(read);
 
-            read_next = read.pointer->next_node.load(std::memory_order_relaxed);
+            // acquire: pairs with the link CAS in LinkChain(), the element is constructed before
+            read_next_node = free_allocate.LinkPointer(read_node->next_node.load(std::memory_order_acquire));
 
-            if(read_next.pointer) {
+            // same as PushF(): a recycled read_node would report a false empty queue
+            if(!FreeAllocateType::SameLink(read, m_read.load(std::memory_order_acquire))) {
+                backoff.Retry();
+                continue;
+            }
 
-                if(read.pointer != write.pointer) {
-                    if(m_read.compare_exchange_strong(read, {read_next.pointer, read.version + 1u})) {
+            if(read_next_node) {
+
+                if(read_node != free_allocate.LinkPointer(write)) {
+                    if(m_read.compare_exchange_strong(read, free_allocate.MakeLink(read_next_node, free_allocate.LinkVersion(read) + 1u))) {
                         break;
                     }
 
+                    m_stats.Add(QUEUE_STAT_READ_CAS_FAILURE);
+                    backoff.Retry();
                 } else {
                     // Push() NOT complete
                     // we can also wait Push() complete
-                    m_write.compare_exchange_strong(write, {read_next.pointer, write.version + 1u});
+                    m_write.compare_exchange_strong(write, free_allocate.MakeLink(read_next_node, free_allocate.LinkVersion(write) + 1u));
                 }
 
             } else {
                 // queue is empty
+                m_stats.Add(QUEUE_STAT_EMPTY);
                 return false;
             }
         }
 
-        {
-            bool ok;
-            int expected;
-            ElementContainer *elem_container = free_allocate.AccessElementPointerAt(read_next.pointer);
+        ReadElement(read_next_node, f);
+        ReleaseEmptyNode(guard, read_node);
+        m_stats.Add(QUEUE_STAT_POP);
 
-            expected = ELEMENT_LIFETIME_CONSTRUCTED;
-            ok = elem_container->lifetime.compare_exchange_strong(expected, ELEMENT_LIFETIME_READING, std::memory_order_acquire);
-            ASSERT_LOG(ok, "element lifetime is invalid: expected=%d, real=%d", ELEMENT_LIFETIME_CONSTRUCTED, expected);
+        return true;
+    }
 
-            f( (ElementType *)elem_container->buffer );
+    // pop at most max elements into out, m_read moves over all of them with one CAS.
+    // return how many elements were popped
+    template<typename OutIterator>
+    size_t PopBatch(size_t max, OutIterator out) {
+        return PopBatchF(max, [&out](ElementType *elem) {
+                *out = std::move(*elem);
+                ++out;
 
-            expected = ELEMENT_LIFETIME_READING;
-            ok = elem_container->lifetime.compare_exchange_strong(expected, ELEMENT_LIFETIME_DESTRUCTED, std::memory_order_release);
-            ASSERT_LOG(ok, "element lifetime is invalid: expected=%d, real=%d", ELEMENT_LIFETIME_READING, expected);
+                elem->~ElementType();
+                });
+    }
+
+    // f(ElementType *elem) is called for each popped element in queue order, see PopF()
+    template<typename Function>
+    size_t PopBatchF(size_t max, Function f) {
+        if(!max) {
+            return 0;
         }
 
-        {
-            int expected;
-            bool ok;
-            ElementContainer *elem_container = free_allocate.AccessElementPointerAt(read.pointer);
+        ReclaimGuard guard = Pin();
+        ElementLink write;
+        ElementLink read;
+        ElementFreeNode *read_node;
+        typename Options::Backoff backoff;
+        size_t count;
 
-            if(MultiReader) {
-                for(;;) {
-                    expected = ELEMENT_LIFETIME_DESTRUCTED;
-                    ok = elem_container->lifetime.compare_exchange_strong(expected, ELEMENT_LIFETIME_RECYCLE, std::memory_order_acquire);
+        for(;;) {
+            // m_read first: m_write read after it is never behind read_node
+            read = m_read.load(std::memory_order_acquire);
+            write = m_write.load(std::memory_order_acquire);
+            read_node = free_allocate.LinkPointer(read);
 
-                    if(ok) {
-                        break;
-                    } else {
-                        std::this_thread::yield();
-                    }
+            ElementFreeNode *write_node = free_allocate.LinkPointer(write);
+            ElementFreeNode *write_next_node = nullptr;
+            ElementFreeNode *last_node = read_node;
+
+            for(count = 0; count < max; ++count) {
+                ElementFreeNode *next_node = free_allocate.LinkPointer(last_node->next_node.load(std::memory_order_acquire));
+
+                if(!next_node) {
+                    break;
                 }
-            } else {
-                expected = ELEMENT_LIFETIME_DESTRUCTED;
-                ok = elem_container->lifetime.compare_exchange_strong(expected, ELEMENT_LIFETIME_RECYCLE, std::memory_order_acquire);
 
-                ASSERT_LOG(ok, "multiple reader detected: element lifetime is invalid: expected=%d, real=%d", ELEMENT_LIFETIME_DESTRUCTED, expected);
+                if(last_node == write_node) {
+                    write_next_node = next_node;
+                }
+
+                last_node = next_node;
+            }
+
+            // the walk is only meaningful if no Pop() moved m_read meanwhile
+            if(!FreeAllocateType::SameLink(read, m_read.load(std::memory_order_acquire))) {
+                backoff.Retry();
+                continue;
+            }
+
+            if(!count) {
+                // queue is empty
+                m_stats.Add(QUEUE_STAT_EMPTY);
+                return 0;
+            }
+
+            if(write_next_node) {
+                // Push() NOT complete inside the range, help it first
+                m_write.compare_exchange_strong(write, free_allocate.MakeLink(write_next_node, free_allocate.LinkVersion(write) + 1u));
+                continue;
             }
 
-            free_allocate.Deallocate(read.pointer);
+            if(m_read.compare_exchange_strong(read, free_allocate.MakeLink(last_node, free_allocate.LinkVersion(read) + 1u))) {
+                break;
+            }
+
+            m_stats.Add(QUEUE_STAT_READ_CAS_FAILURE);
+            backoff.Retry();
         }
 
-        return true;
+        // read_node is the old "empty node", the popped nodes but the last one are ours
+        // to recycle, the last one becomes the new "empty node"
+        ElementFreeNode *elem_node = read_node;
+
+        for(size_t i = 0; i < count; ++i) {
+            ElementFreeNode *next_node = free_allocate.LinkPointer(elem_node->next_node.load(std::memory_order_relaxed));
+
+            ReadElement(next_node, f);
+            ReleaseEmptyNode(guard, elem_node);
+
+            elem_node = next_node;
+        }
+
+        m_stats.Add(QUEUE_STAT_POP, count);
+
+        return count;
     }
 
     template<typename Function>
@@ -204,6 +400,8 @@ private:
         ELEMENT_LIFETIME_READING,
         ELEMENT_LIFETIME_DESTRUCTED,
         ELEMENT_LIFETIME_RECYCLE,
+        // flag: unlinked by a later Pop() before its reader finished, the reader recycles it
+        ELEMENT_LIFETIME_UNLINKED = 0x100,
     };
 
     struct ElementContainer {
@@ -211,9 +409,187 @@ private:
         std::atomic<int> lifetime;
     };
 
-    using FreeAllocateType = FreeAllocate<ElementContainer>;
+    using FreeAllocateType = FreeAllocate<ElementContainer, typename Options::AllocateOptions>;
     using ElementFreeNode = typename FreeAllocateType::ElementFreeNode;
-    using ElementVersionPointer = typename FreeAllocateType::ElementVersionPointer;
+    using ElementLink = typename FreeAllocateType::ElementLink;
+
+    using ReclaimType = EpochReclaim<typename Options::ReclaimOptions>;
+
+    struct NoReclaim {
+    };
+
+    struct NoGuard {
+    };
+
+    using ReclaimGuard = typename std::conditional<ReclaimEnabled, typename ReclaimType::Guard, NoGuard>::type;
+
+    ReclaimGuard Pin() {
+        if constexpr (ReclaimEnabled) {
+            return m_reclaim.Pin();
+        } else {
+            return NoGuard();
+        }
+    }
+
+    // construct the element and make elem_node the end of a chain, still private
+    template<typename Function>
+    void PrepareNode(ElementFreeNode *elem_node, Function &f) {
+        ElementContainer *elem_container = free_allocate.AccessElementPointerAt(elem_node);
+        f( (ElementType *)elem_container->buffer );
+        elem_container->lifetime.store(ELEMENT_LIFETIME_CONSTRUCTED, std::memory_order_relaxed);
+
+        ElementLink next_elem_node = elem_node->next_node.load(std::memory_order_relaxed);
+        elem_node->next_node.store(free_allocate.MakeLink(nullptr, free_allocate.LinkVersion(next_elem_node) + 1u), std::memory_order_relaxed);
+    }
+
+    // splice the private chain first -> ... -> last onto the tail. called pinned
+    void LinkChain(ElementFreeNode *first_node, ElementFreeNode *last_node) {
+        ElementLink write;
+        ElementLink write_next;
+        ElementFreeNode *write_node;
+        ElementFreeNode *write_next_node;
+        typename Options::Backoff backoff;
+        for(;;) {
+            // acquire: write_node may be a heap node made by the pusher that linked it
+            write = m_write.load(std::memory_order_acquire);
+            write_node = free_allocate.LinkPointer(write);
+            // acquire: write_next_node may be a heap node made by its pusher, and we may
+            // help m_write on to it, which must pass its construction on to the next pusher
+            write_next = write_node->next_node.load(std::memory_order_acquire);
+            write_next_node = free_allocate.LinkPointer(write_next);
+
+            // write_node may have been popped and recycled since m_write was read,
+            // its next_node is only meaningful while it is still the tail
+            if(!FreeAllocateType::SameLink(write, m_write.load(std::memory_order_acquire))) {
+                backoff.Retry();
+                continue;
+            }
+
+            // for multiple Push(), only one operation's write_next_node is nullptr.
+            // other Push() must wait until write_next_node is nullptr.
+            if(!write_next_node) {
+                // for multiple Push(), once this CAS operation is successful,
+                // other Push() will meet write_next_node NOT nullptr
+                if(write_node->next_node.compare_exchange_strong(write_next, free_allocate.MakeLink(first_node, free_allocate.LinkVersion(write_next) + 1u))) {
+                    // other Push() walk the rest of a chain by helping
+                    m_write.compare_exchange_strong(write, free_allocate.MakeLink(last_node, free_allocate.LinkVersion(write) + 1u));
+                    break;
+                }
+
+                m_stats.Add(QUEUE_STAT_WRITE_CAS_FAILURE);
+                backoff.Retry();
+            } else {
+                // help change m_write to its right value
+                // we can also wait last success Push() to complete this operation
+                m_write.compare_exchange_strong(write, free_allocate.MakeLink(write_next_node, free_allocate.LinkVersion(write) + 1u));
+            }
+        }
+    }
+
+    // pop side of an element: read it with f, the last of its reader and its unlinker
+    // recycles the node
+    template<typename Function>
+    void ReadElement(ElementFreeNode *elem_node, Function &f) {
+        bool ok;
+        int expected;
+        ElementContainer *elem_container = free_allocate.AccessElementPointerAt(elem_node);
+
+        // a later Pop() may have unlinked elem_node already, keep its flag
+        expected = ELEMENT_LIFETIME_CONSTRUCTED;
+        ok = elem_container->lifetime.compare_exchange_strong(expected, ELEMENT_LIFETIME_READING, std::memory_order_acquire);
+
+        if(!ok && expected == (ELEMENT_LIFETIME_CONSTRUCTED | ELEMENT_LIFETIME_UNLINKED)) {
+            ok = elem_container->lifetime.compare_exchange_strong(expected, ELEMENT_LIFETIME_READING | ELEMENT_LIFETIME_UNLINKED, std::memory_order_acquire);
+        }
+
+        ASSERT_LOG(ok, "element lifetime is invalid: expected=%d, real=%d", ELEMENT_LIFETIME_CONSTRUCTED, expected);
+
+        f( (ElementType *)elem_container->buffer );
+
+        expected = ELEMENT_LIFETIME_READING;
+        ok = elem_container->lifetime.compare_exchange_strong(expected, ELEMENT_LIFETIME_DESTRUCTED, std::memory_order_acq_rel);
+
+        if(!ok) {
+            // unlinked while we read it, the recycle was left to us
+            ASSERT_LOG(expected == (ELEMENT_LIFETIME_READING | ELEMENT_LIFETIME_UNLINKED), "element lifetime is invalid: expected=%d, real=%d", ELEMENT_LIFETIME_READING, expected);
+            elem_container->lifetime.store(ELEMENT_LIFETIME_RECYCLE, std::memory_order_relaxed);
+            FreeNode(elem_node);
+        }
+    }
+
+    // elem_node is no longer reachable from m_read, recycle it once nobody reads it
+    void ReleaseEmptyNode(ReclaimGuard &guard, ElementFreeNode *elem_node) {
+        if constexpr (ReclaimEnabled) {
+            // a popper still in f on elem_node is pinned, so the node outlives it
+            m_reclaim.Retire(guard, elem_node, &LinkedQueue::FreeNodeOf, this);
+        } else {
+            int expected;
+            bool ok;
+            ElementContainer *elem_container = free_allocate.AccessElementPointerAt(elem_node);
+
+            if(MultiReader) {
+                // whoever of us and the reader of elem_node finishes last recycles it,
+                // a reader stalled before or in f never holds this Pop() up
+                expected = elem_container->lifetime.fetch_or(ELEMENT_LIFETIME_UNLINKED, std::memory_order_acq_rel);
+
+                if(expected == ELEMENT_LIFETIME_DESTRUCTED) {
+                    elem_container->lifetime.store(ELEMENT_LIFETIME_RECYCLE, std::memory_order_relaxed);
+                    FreeNode(elem_node);
+                } else {
+                    ASSERT_LOG(expected == ELEMENT_LIFETIME_CONSTRUCTED || expected == ELEMENT_LIFETIME_READING, "element lifetime is invalid: real=%d", expected);
+                }
+            } else {
+                expected = ELEMENT_LIFETIME_DESTRUCTED;
+                ok = elem_container->lifetime.compare_exchange_strong(expected, ELEMENT_LIFETIME_RECYCLE, std::memory_order_acquire);
+
+                ASSERT_LOG(ok, "multiple reader detected: element lifetime is invalid: expected=%d, real=%d", ELEMENT_LIFETIME_DESTRUCTED, expected);
+
+                FreeNode(elem_node);
+            }
+        }
+    }
+
+    // called unpinned
+    ElementFreeNode *AllocateNode() {
+        ElementFreeNode *elem_node = free_allocate.Allocate();
+
+        if constexpr (ReclaimEnabled && !Options::Unbounded) {
+            // popped nodes may still wait for their grace period. it takes two epochs,
+            // and this thread must not be pinned or the epoch can not move on
+            for(int i = 0; !elem_node && i < 3; ++i) {
+                if(i) {
+                    // let a pinned thread that holds the epoch back run
+                    std::this_thread::yield();
+                }
+
+                m_reclaim.Collect();
+                elem_node = free_allocate.Allocate();
+            }
+        }
+
+        if constexpr (Options::Unbounded) {
+            if(!elem_node) {
+                elem_node = new (std::nothrow) ElementFreeNode();
+            }
+        }
+
+        return elem_node;
+    }
+
+    void FreeNode(ElementFreeNode *elem_node) {
+        if constexpr (Options::Unbounded) {
+            if(!free_allocate.Contains(elem_node)) {
+                delete elem_node;
+                return;
+            }
+        }
+
+        free_allocate.Deallocate(elem_node);
+    }
+
+    static void FreeNodeOf(void *context, void *pointer) {
+        ((LinkedQueue *)context)->FreeNode((ElementFreeNode *)pointer);
+    }
 
     LinkedQueue(const LinkedQueue &);
     LinkedQueue(LinkedQueue &&);
@@ -222,10 +598,13 @@ private:
 
     FreeAllocateType free_allocate;
 
-    std::atomic<ElementVersionPointer> m_read;
-    std::atomic<ElementVersionPointer> m_write;
+    std::atomic<ElementLink> m_read;
+    std::atomic<ElementLink> m_write;
+
+    typename Options::Stats m_stats;
 
-    size_t m_capacity;
+    // destructed before free_allocate, retired nodes go back to it
+    typename std::conditional<ReclaimEnabled, ReclaimType, NoReclaim>::type m_reclaim;
 };
 
 
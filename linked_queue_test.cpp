@@ -2,6 +2,7 @@
 #include <stdio.h>
 #include <thread>
 #include <vector>
+#include <string>
 #include <assert.h>
 #include <signal.h>
 
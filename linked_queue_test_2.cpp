@@ -0,0 +1,102 @@
+#include "linked_queue.h"
+
+#include <vector>
+#include <thread>
+
+#include <signal.h>
+
+// compact 64 bit head with elastic slabs, built without -mcx16 and libatomic.
+// every popper checks that it sees each producer's counters in increasing order,
+// and push/pop counts must match after Clear()
+
+struct CompactElasticAllocateOptions : FreeAllocateCompactOptions {
+    static constexpr size_t MaxSlabs = 16;
+};
+
+struct CompactElasticOptions : LinkedQueueDefaultOptions {
+    using AllocateOptions = CompactElasticAllocateOptions;
+};
+
+struct Element {
+    unsigned long producer;
+    unsigned long counter;
+};
+
+static constexpr int Pushers = 2;
+static constexpr int Popers = 4;
+
+static std::atomic<int> stop = ATOMIC_VAR_INIT(0);
+
+static void sig_handler(int sig) {
+    stop.store(1, std::memory_order_relaxed);
+}
+
+static std::atomic<unsigned long long> push_success(0);
+static std::atomic<unsigned long long> pop_success(0);
+static std::atomic<unsigned long long> order_errors(0);
+
+int main() {
+    std::vector<std::thread> pushers;
+    std::vector<std::thread> popers;
+
+    signal(SIGINT, sig_handler);
+    signal(SIGTERM, sig_handler);
+
+    LinkedQueue<Element, true, CompactElasticOptions> q(1000, MappedMemoryOptions(), FreeAllocateGrowth{1000, 10000});
+
+    for(int i = 0; i < Pushers; ++i) {
+        pushers.emplace_back([&q, i]() {
+                Element e{(unsigned long)i, 0};
+
+                for(;!stop;) {
+                    if(q.Push(e)) {
+                        ++e.counter;
+                        push_success.fetch_add(1u, std::memory_order_relaxed);
+                    }
+                }
+                });
+    }
+
+    for(int i = 0; i < Popers; ++i) {
+        popers.emplace_back([&q]() {
+                std::vector<unsigned long> next(Pushers, 0);
+                Element e;
+
+                for(;!stop;) {
+                    if(q.Pop(&e)) {
+                        if(e.producer >= (unsigned long)Pushers || e.counter < next[e.producer]) {
+                            order_errors.fetch_add(1u, std::memory_order_relaxed);
+                        } else {
+                            next[e.producer] = e.counter + 1u;
+                        }
+
+                        pop_success.fetch_add(1u, std::memory_order_relaxed);
+                    }
+                }
+                });
+    }
+
+    for(size_t i = 0; i < pushers.size(); ++i) {
+        pushers[i].join();
+    }
+
+    for(size_t i = 0; i < popers.size(); ++i) {
+        popers[i].join();
+    }
+
+    unsigned long long left = 0;
+
+    q.ClearF([&left](Element *elem) {
+            ++left;
+            });
+
+    printf("push_success=%llu, pop_success=%llu, left=%llu, capacity=%lu, order_errors=%llu\n",
+            push_success.load(), pop_success.load(), left, q.GetCapacity(), order_errors.load());
+
+    if(push_success.load() != pop_success.load() + left || order_errors.load()) {
+        fprintf(stderr, "FAILED\n");
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,138 @@
+#include "linked_queue.h"
+
+#include <vector>
+#include <thread>
+#include <chrono>
+
+#include <signal.h>
+
+// popper stalls: a default queue where the last of unlinker and reader recycles a node,
+// a bounded queue recycling through EpochReclaim, and an unbounded queue that goes past
+// its preallocated nodes into the heap. some Pop() callbacks sleep, the other poppers
+// must keep going meanwhile. every popper checks each producer's counters are
+// increasing, and push/pop counts must match after Clear()
+
+struct Element {
+    unsigned long producer;
+    unsigned long counter;
+    std::vector<int> payload;
+};
+
+static constexpr int Pushers = 2;
+static constexpr int Popers = 4;
+
+static std::atomic<int> stop = ATOMIC_VAR_INIT(0);
+
+static void sig_handler(int sig) {
+    stop.store(1, std::memory_order_relaxed);
+}
+
+template<typename Queue>
+static int run(Queue *q, const char *name) {
+    std::atomic<unsigned long long> push_success(0);
+    std::atomic<unsigned long long> pop_success(0);
+    std::atomic<unsigned long long> order_errors(0);
+    std::atomic<unsigned long long> slow_pops(0);
+
+    std::vector<std::thread> pushers;
+    std::vector<std::thread> popers;
+
+    for(int i = 0; i < Pushers; ++i) {
+        pushers.emplace_back([&, i]() {
+                Element e{(unsigned long)i, 0, {1, 2, 3}};
+
+                while(!stop.load(std::memory_order_relaxed)) {
+                    // keep the unbounded queue from eating all memory when poppers fall behind
+                    if(push_success.load(std::memory_order_relaxed) > pop_success.load(std::memory_order_relaxed) + 100000u) {
+                        std::this_thread::yield();
+                        continue;
+                    }
+
+                    if(q->Push(e)) {
+                        ++e.counter;
+                        push_success.fetch_add(1u, std::memory_order_relaxed);
+                    }
+                }
+                });
+    }
+
+    for(int i = 0; i < Popers; ++i) {
+        popers.emplace_back([&, i]() {
+                std::vector<unsigned long> next(Pushers, 0);
+                unsigned long n = 0;
+
+                while(!stop.load(std::memory_order_relaxed)) {
+                    bool ok = q->PopF([&](Element *elem) {
+                            if(elem->producer >= (unsigned long)Pushers || elem->counter < next[elem->producer]) {
+                                order_errors.fetch_add(1u, std::memory_order_relaxed);
+                            } else {
+                                next[elem->producer] = elem->counter + 1u;
+                            }
+
+                            // popper 0 stalls inside the callback now and then
+                            if(i == 0 && ++n % 10000 == 0) {
+                                slow_pops.fetch_add(1u, std::memory_order_relaxed);
+                                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                            }
+
+                            elem->~Element();
+                            });
+
+                    if(ok) {
+                        pop_success.fetch_add(1u, std::memory_order_relaxed);
+                    }
+                }
+                });
+    }
+
+    for(size_t i = 0; i < pushers.size(); ++i) {
+        pushers[i].join();
+    }
+
+    for(size_t i = 0; i < popers.size(); ++i) {
+        popers[i].join();
+    }
+
+    unsigned long long left = 0;
+
+    q->ClearF([&left](Element *elem) {
+            elem->~Element();
+            ++left;
+            });
+
+    printf("%s push_success=%llu, pop_success=%llu, left=%llu, slow_pops=%llu, order_errors=%llu\n",
+            name, push_success.load(), pop_success.load(), left, slow_pops.load(), order_errors.load());
+
+    if(push_success.load() != pop_success.load() + left || order_errors.load()) {
+        fprintf(stderr, "%s FAILED\n", name);
+        return 1;
+    }
+
+    return 0;
+}
+
+int main() {
+    signal(SIGINT, sig_handler);
+    signal(SIGTERM, sig_handler);
+
+    LinkedQueue<Element, true> handoff(1000);
+    LinkedQueue<Element, true, LinkedQueueReclaimOptions> bounded(1000);
+    LinkedQueue<Element, true, LinkedQueueUnboundedOptions> unbounded(100);
+
+    int handoff_ret = 0;
+    int bounded_ret = 0;
+
+    std::thread t1([&handoff_ret, &handoff]() {
+            handoff_ret = run(&handoff, "handoff");
+            });
+
+    std::thread t2([&bounded_ret, &bounded]() {
+            bounded_ret = run(&bounded, "bounded");
+            });
+
+    int unbounded_ret = run(&unbounded, "unbounded");
+    t1.join();
+    t2.join();
+
+    return handoff_ret | bounded_ret | unbounded_ret;
+}
@@ -0,0 +1,117 @@
+#include "linked_queue.h"
+#include "fixed_queue.h"
+
+#include <vector>
+#include <string>
+#include <thread>
+#include <memory>
+
+#include <signal.h>
+
+// dequeue without copies: Pop() moves and ConsumeInPlace() reads the stored element.
+// Element counts its copies, there must be none on either queue
+
+static std::atomic<int> stop = ATOMIC_VAR_INIT(0);
+
+static void sig_handler(int sig) {
+    stop.store(1, std::memory_order_relaxed);
+}
+
+static std::atomic<unsigned long long> copies(0);
+
+struct Element {
+    Element() = default;
+
+    Element(unsigned long c) : counter(c), tag{"__TAG__", "__ANOTHER_TAG__",} {}
+
+    Element(const Element &other) : counter(other.counter), tag(other.tag) {
+        copies.fetch_add(1u, std::memory_order_relaxed);
+    }
+
+    Element(Element &&other) = default;
+
+    Element &operator=(const Element &other) {
+        counter = other.counter;
+        tag = other.tag;
+        copies.fetch_add(1u, std::memory_order_relaxed);
+        return *this;
+    }
+
+    Element &operator=(Element &&other) = default;
+
+    unsigned long counter = 0;
+    std::vector<std::string> tag;
+};
+
+template<typename Queue>
+static void Run(const char *name, std::shared_ptr<Queue> q, std::vector<std::thread> &threads) {
+    for(int i = 0; i < 2; ++i) {
+        threads.emplace_back([q]() {
+                unsigned long counter = 0;
+
+                while(!stop.load(std::memory_order_relaxed)) {
+                    Element e(counter);
+
+                    if(q->Push(std::move(e))) {
+                        ++counter;
+                    }
+                }
+                });
+    }
+
+    for(int i = 0; i < 2; ++i) {
+        threads.emplace_back([q, name, i]() {
+                unsigned long pops = 0;
+                unsigned long consumes = 0;
+                unsigned long bad_tags = 0;
+
+                while(!stop.load(std::memory_order_relaxed)) {
+                    // the two readers use different APIs, also alternate in each
+                    if((pops + consumes + i) % 2) {
+                        Element e;
+
+                        if(q->Pop(&e)) {
+                            bad_tags += e.tag.size() != 2u;
+                            ++pops;
+                        }
+                    } else {
+                        bool ok = q->ConsumeInPlace([&bad_tags](Element &e) {
+                                bad_tags += e.tag.size() != 2u;
+                                });
+
+                        consumes += ok;
+                    }
+                }
+
+                printf("%s reader %d: pops=%lu, consumes=%lu, bad_tags=%lu\n", name, i, pops, consumes, bad_tags);
+                });
+    }
+}
+
+int main() {
+    std::vector<std::thread> threads;
+
+    signal(SIGINT, sig_handler);
+    signal(SIGTERM, sig_handler);
+
+    std::shared_ptr<LinkedQueue<Element>> lq = std::make_shared<LinkedQueue<Element>>(10000);
+    std::shared_ptr<FixedQueue<Element, 10000>> fq = std::make_shared<FixedQueue<Element, 10000>>();
+
+    Run("linked_queue", lq, threads);
+    Run("fixed_queue", fq, threads);
+
+    for(size_t i = 0; i < threads.size(); ++i) {
+        threads[i].join();
+    }
+
+    lq->Clear();
+
+    printf("copies=%llu\n", copies.load());
+
+    if(copies.load()) {
+        fprintf(stderr, "element copied on dequeue path\n");
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,157 @@
+#include "linked_queue.h"
+
+#include <vector>
+#include <thread>
+
+#include <signal.h>
+
+// batches: pushers alternate Push() and PushBatch() of random length, poppers alternate
+// Pop() and PopBatch(). a batch must stay in one piece, so every popper checks it sees
+// each producer's counters increasing, and push/pop counts must match after Clear()
+
+struct Element {
+    unsigned long producer;
+    unsigned long counter;
+    std::vector<int> payload;
+};
+
+static constexpr int Pushers = 2;
+static constexpr int Popers = 3;
+static constexpr size_t MaxBatch = 32;
+
+static std::atomic<int> stop = ATOMIC_VAR_INIT(0);
+
+static void sig_handler(int sig) {
+    stop.store(1, std::memory_order_relaxed);
+}
+
+template<typename Queue>
+static int run(Queue *q, const char *name) {
+    std::atomic<unsigned long long> push_success(0);
+    std::atomic<unsigned long long> pop_success(0);
+    std::atomic<unsigned long long> batch_pops(0);
+    std::atomic<unsigned long long> order_errors(0);
+
+    std::vector<std::thread> pushers;
+    std::vector<std::thread> popers;
+
+    for(int i = 0; i < Pushers; ++i) {
+        pushers.emplace_back([&, i]() {
+                unsigned long counter = 0;
+                unsigned int seed = i + 1;
+                std::vector<Element> batch;
+
+                while(!stop.load(std::memory_order_relaxed)) {
+                    size_t n = rand_r(&seed) % MaxBatch;
+
+                    if(n < 2) {
+                        if(q->Push(Element{(unsigned long)i, counter, {1, 2, 3}})) {
+                            ++counter;
+                            push_success.fetch_add(1u, std::memory_order_relaxed);
+                        }
+
+                        continue;
+                    }
+
+                    batch.clear();
+                    for(size_t j = 0; j < n; ++j) {
+                        batch.push_back(Element{(unsigned long)i, counter + j, {1, 2, 3}});
+                    }
+
+                    // a partial batch pushes a prefix, the rest is rebuilt next round
+                    size_t pushed = q->PushBatch(batch.begin(), batch.end());
+                    counter += pushed;
+                    push_success.fetch_add(pushed, std::memory_order_relaxed);
+                }
+                });
+    }
+
+    for(int i = 0; i < Popers; ++i) {
+        popers.emplace_back([&, i]() {
+                std::vector<unsigned long> next(Pushers, 0);
+                std::vector<Element> out(MaxBatch);
+                unsigned int seed = i + 100;
+
+                auto check = [&](const Element &e) {
+                    if(e.producer >= (unsigned long)Pushers || e.counter < next[e.producer] || e.payload.size() != 3u) {
+                        order_errors.fetch_add(1u, std::memory_order_relaxed);
+                    } else {
+                        next[e.producer] = e.counter + 1u;
+                    }
+                };
+
+                while(!stop.load(std::memory_order_relaxed)) {
+                    size_t max = rand_r(&seed) % MaxBatch;
+
+                    if(max < 2) {
+                        if(q->Pop(&out[0])) {
+                            check(out[0]);
+                            pop_success.fetch_add(1u, std::memory_order_relaxed);
+                        }
+
+                        continue;
+                    }
+
+                    size_t n = q->PopBatch(max, out.begin());
+
+                    for(size_t j = 0; j < n; ++j) {
+                        check(out[j]);
+                    }
+
+                    pop_success.fetch_add(n, std::memory_order_relaxed);
+                    batch_pops.fetch_add(n > 1, std::memory_order_relaxed);
+                }
+                });
+    }
+
+    for(size_t i = 0; i < pushers.size(); ++i) {
+        pushers[i].join();
+    }
+
+    for(size_t i = 0; i < popers.size(); ++i) {
+        popers[i].join();
+    }
+
+    unsigned long long left = 0;
+
+    q->ClearF([&left](Element *elem) {
+            elem->~Element();
+            ++left;
+            });
+
+    printf("%s push_success=%llu, pop_success=%llu, left=%llu, batch_pops=%llu, order_errors=%llu\n",
+            name, push_success.load(), pop_success.load(), left, batch_pops.load(), order_errors.load());
+
+    if(push_success.load() != pop_success.load() + left || order_errors.load()) {
+        fprintf(stderr, "%s FAILED\n", name);
+        return 1;
+    }
+
+    return 0;
+}
+
+int main() {
+    signal(SIGINT, sig_handler);
+    signal(SIGTERM, sig_handler);
+
+    LinkedQueue<Element, true> handoff(1000);
+    LinkedQueue<Element, true, LinkedQueueReclaimOptions> bounded(1000);
+    LinkedQueue<Element, true, LinkedQueueCompactOptions> compact(1000);
+
+    int handoff_ret = 0;
+    int bounded_ret = 0;
+
+    std::thread t1([&handoff_ret, &handoff]() {
+            handoff_ret = run(&handoff, "handoff");
+            });
+
+    std::thread t2([&bounded_ret, &bounded]() {
+            bounded_ret = run(&bounded, "bounded");
+            });
+
+    int compact_ret = run(&compact, "compact");
+    t1.join();
+    t2.join();
+
+    return handoff_ret | bounded_ret | compact_ret;
+}
@@ -0,0 +1,123 @@
+#ifndef __MAPPED_MEMORY_H__
+#define __MAPPED_MEMORY_H__
+
+#include <stddef.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+// anonymous mmap backed memory for big rings and pools:
+// optional MAP_HUGETLB, transparent huge page advice and NUMA node placement.
+// no libnuma needed, placement is done by the mbind syscall directly.
+
+enum MAPPED_MEMORY_NODE {
+    MAPPED_MEMORY_NODE_ANY = -1, // let the kernel decide (first touch)
+    MAPPED_MEMORY_NODE_LOCAL = -2, // the node of the cpu calling MappedMemoryAllocate()
+};
+
+struct MappedMemoryOptions {
+    // try MAP_HUGETLB first (needs reserved huge pages), fall back to normal pages
+    bool huge_pages = false;
+    // madvise(MADV_HUGEPAGE) on normal pages, so THP can back the region
+    bool transparent_huge_pages = true;
+    // fault in all pages at allocation time instead of on first access
+    bool populate = false;
+    // MAPPED_MEMORY_NODE_ANY, MAPPED_MEMORY_NODE_LOCAL, or a NUMA node id
+    int numa_node = MAPPED_MEMORY_NODE_ANY;
+};
+
+static constexpr size_t MappedMemoryHugePageSize = 2u * 1024u * 1024u;
+
+static inline int MappedMemoryCurrentNode() {
+    unsigned cpu = 0;
+    unsigned node = 0;
+
+    if(syscall(SYS_getcpu, &cpu, &node, nullptr) != 0) {
+        return 0;
+    }
+
+    return (int)node;
+}
+
+static inline void MappedMemoryBindNode(void *addr, size_t bytes, int node) {
+#ifdef SYS_mbind
+    static constexpr int MPOL_PREFERRED_MODE = 1;
+    static constexpr size_t MaxNodes = sizeof(unsigned long) * 8u;
+
+    if(node < 0 || (size_t)node >= MaxNodes) {
+        return;
+    }
+
+    unsigned long nodemask = 1ul << node;
+
+    // preferred, not bind: fall back to other nodes instead of failing page faults
+    if(syscall(SYS_mbind, addr, bytes, MPOL_PREFERRED_MODE, &nodemask, MaxNodes + 1u, 0) != 0) {
+        fprintf(stderr, "[%s:%d:%s] mbind to node %d failed, memory is not node local\n", __FILE__, __LINE__, __FUNCTION__, node);
+    }
+#endif
+}
+
+// return nullptr if mmap failed. *mapped_bytes receives the length to pass to MappedMemoryFree()
+static inline void *MappedMemoryAllocate(size_t bytes, const MappedMemoryOptions &options, size_t *mapped_bytes) {
+    void *p = MAP_FAILED;
+    size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+    size_t length;
+    int node = options.numa_node == MAPPED_MEMORY_NODE_LOCAL ? MappedMemoryCurrentNode() : options.numa_node;
+
+    if(bytes == 0) {
+        bytes = 1;
+    }
+
+#ifdef MAP_HUGETLB
+    if(options.huge_pages) {
+        length = (bytes + MappedMemoryHugePageSize - 1u) / MappedMemoryHugePageSize * MappedMemoryHugePageSize;
+        p = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    }
+#endif
+
+    if(p == MAP_FAILED) {
+        length = (bytes + page_size - 1u) / page_size * page_size;
+        p = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+        if(p == MAP_FAILED) {
+            return nullptr;
+        }
+
+#ifdef MADV_HUGEPAGE
+        if(options.transparent_huge_pages && length >= MappedMemoryHugePageSize) {
+            madvise(p, length, MADV_HUGEPAGE);
+        }
+#endif
+    }
+
+    // before any page is touched, so first faults already land on the node
+    if(node >= 0) {
+        MappedMemoryBindNode(p, length, node);
+    }
+
+    if(options.populate) {
+        for(size_t off = 0; off < length; off += page_size) {
+            ((volatile char *)p)[off] = 0;
+        }
+    }
+
+    *mapped_bytes = length;
+    return p;
+}
+
+// give the pages back to the OS but keep the address range mapped.
+// later reads see zero filled pages, writes fault in fresh ones
+static inline void MappedMemoryDecommit(void *p, size_t mapped_bytes) {
+    if(p) {
+        madvise(p, mapped_bytes, MADV_DONTNEED);
+    }
+}
+
+static inline void MappedMemoryFree(void *p, size_t mapped_bytes) {
+    if(p) {
+        munmap(p, mapped_bytes);
+    }
+}
+
+#endif
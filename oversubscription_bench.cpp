@@ -0,0 +1,155 @@
+#include "fixed_queue.h"
+#include "linked_queue.h"
+#include "backoff.h"
+#include "latency_histogram.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread>
+#include <vector>
+#include <memory>
+#include <chrono>
+
+// usage: oversubscription_bench.out [seconds_per_run] [max_oversubscription]
+//
+// the backoff policies of backoff.h under 1, 2, 4 ... max_oversubscription threads per
+// cpu, half pushing and half popping. a thread descheduled between taking a pos and
+// finishing its slot stalls every thread that waits for that slot, which is where the
+// policies differ: pause spinning holds the cpu the stalled thread needs, yield costs a
+// syscall per miss, parking gives the cpu away for longer. ops/sec counts successful
+// Push + Pop, latency is push-to-pop of each element
+
+static constexpr size_t BenchCapacity = 4096;
+
+static uint64_t NowNs() {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+template<typename BackoffPolicy>
+struct RwrefOptions : FixedQueueDefaultOptions {
+    using Backoff = BackoffPolicy;
+};
+
+template<typename BackoffPolicy>
+struct SequenceOptions : FixedQueueSequenceOptions {
+    using Backoff = BackoffPolicy;
+};
+
+template<typename BackoffPolicy>
+struct NodeOptions : FreeAllocateDefaultOptions {
+    using Backoff = BackoffPolicy;
+};
+
+template<typename BackoffPolicy>
+struct LinkedOptions : LinkedQueueDefaultOptions {
+    using AllocateOptions = NodeOptions<BackoffPolicy>;
+    using Backoff = BackoffPolicy;
+};
+
+template<typename Queue>
+static void Run(const char *structure, const char *backoff, int threads, double seconds) {
+    std::unique_ptr<Queue> q_p = std::make_unique<Queue>(BenchCapacity);
+    Queue &q = *q_p;
+
+    std::atomic<int> start = ATOMIC_VAR_INIT(0);
+    std::atomic<int> stop = ATOMIC_VAR_INIT(0);
+    std::atomic<unsigned long long> ops = ATOMIC_VAR_INIT(0);
+
+    int producers = threads / 2;
+    int consumers = threads - producers;
+
+    std::vector<LatencyHistogram<>> histograms(consumers);
+    std::vector<std::thread> workers;
+
+    for(int i = 0; i < producers; ++i) {
+        workers.emplace_back([&]() {
+                unsigned long long n = 0;
+                while(!start.load(std::memory_order_acquire));
+                while(!stop.load(std::memory_order_relaxed)) {
+                    if(q.Push(NowNs())) {
+                        ++n;
+                    }
+                }
+                ops.fetch_add(n, std::memory_order_relaxed);
+                });
+    }
+
+    for(int i = 0; i < consumers; ++i) {
+        workers.emplace_back([&, i]() {
+                LatencyHistogram<> &histogram = histograms[i];
+                unsigned long long n = 0;
+                uint64_t timestamp;
+                while(!start.load(std::memory_order_acquire));
+                while(!stop.load(std::memory_order_relaxed)) {
+                    if(q.Pop(&timestamp)) {
+                        uint64_t now = NowNs();
+                        histogram.Record(now > timestamp ? now - timestamp : 0);
+                        ++n;
+                    }
+                }
+                ops.fetch_add(n, std::memory_order_relaxed);
+                });
+    }
+
+    auto begin = std::chrono::steady_clock::now();
+    start.store(1, std::memory_order_release);
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+    stop.store(1, std::memory_order_relaxed);
+
+    for(size_t i = 0; i < workers.size(); ++i) {
+        workers[i].join();
+    }
+
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    LatencyHistogram<> latency;
+    for(int i = 0; i < consumers; ++i) {
+        latency.Merge(histograms[i]);
+    }
+
+    uint64_t timestamp;
+    while(q.Pop(&timestamp));
+
+    printf("%-14s %-18s threads=%-4d ops/sec=%-10.0f p50_ns=%-9lu p99_ns=%-10lu max_ns=%lu\n",
+            structure, backoff, threads, ops.load() / elapsed, (unsigned long)latency.Percentile(50.0),
+            (unsigned long)latency.Percentile(99.0), (unsigned long)latency.GetMax());
+    fflush(stdout);
+}
+
+template<typename Backoff>
+static void RunPolicy(const char *backoff, int threads, double seconds) {
+    Run<FixedQueue<uint64_t, FixedQueueDynamicCapacity, RwrefOptions<Backoff>>>("fixed_rwref", backoff, threads, seconds);
+    Run<FixedQueue<uint64_t, FixedQueueDynamicCapacity, SequenceOptions<Backoff>>>("fixed_sequence", backoff, threads, seconds);
+    Run<LinkedQueue<uint64_t, true, LinkedOptions<Backoff>>>("linked_queue", backoff, threads, seconds);
+}
+
+int main(int argc, char **argv) {
+    double seconds = argc > 1 ? atof(argv[1]) : 1.0;
+    int max_oversubscription = argc > 2 ? atoi(argv[2]) : 16;
+    int cpus = (int)std::thread::hardware_concurrency();
+
+    if(cpus < 1) {
+        cpus = 1;
+    }
+
+    printf("== backoff policies, cpus=%d, capacity=%lu ==\n", cpus, (unsigned long)BenchCapacity);
+
+    for(int per_cpu = 1, last_threads = 0; per_cpu <= max_oversubscription; per_cpu *= 2) {
+        int threads = per_cpu * cpus < 2 ? 2 : per_cpu * cpus;
+
+        if(threads == last_threads) {
+            // one cpu: 1 and 2 per cpu both run 2 threads
+            continue;
+        }
+
+        last_threads = threads;
+
+        RunPolicy<BackoffDefault>("default", threads, seconds);
+        RunPolicy<BackoffExponentialPause<>>("exponential_pause", threads, seconds);
+        RunPolicy<BackoffSpinYield<>>("spin_yield", threads, seconds);
+        RunPolicy<BackoffSpinPark<>>("spin_park", threads, seconds);
+    }
+
+    return 0;
+}
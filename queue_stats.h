@@ -0,0 +1,130 @@
+#ifndef __QUEUE_STATS_H__
+#define __QUEUE_STATS_H__
+
+#include "cache_line.h"
+
+#include <atomic>
+
+#include <stddef.h>
+#include <stdint.h>
+
+// operation and contention counters of FixedQueue, LinkedQueue and FreeAllocate.
+// selected by Options::Stats: QueueNoStats compiles every count away, QueueStats<>
+// counts into per-thread shards, each on its own cache lines, so counting threads do
+// not share lines. GetStats() of the queue sums the shards into a QueueStatsSnapshot.
+
+enum QUEUE_STAT {
+    QUEUE_STAT_PUSH = 0, // elements pushed
+    QUEUE_STAT_POP, // elements popped
+    QUEUE_STAT_FULL, // push calls that pushed nothing: queue full or pool used up
+    QUEUE_STAT_EMPTY, // pop calls that popped nothing
+    QUEUE_STAT_WRITE_CAS_FAILURE, // lost CAS on the write cursor (LinkedQueue: on the tail link)
+    QUEUE_STAT_READ_CAS_FAILURE, // lost CAS on the read cursor
+    QUEUE_STAT_SLOT_YIELD, // Backoff::Wait() calls while waiting for a slot of a reserved pos
+    QUEUE_STAT_ALLOCATE, // FreeAllocate: nodes handed out
+    QUEUE_STAT_DEALLOCATE, // FreeAllocate: nodes given back
+    QUEUE_STAT_ALLOCATE_FAILURE, // FreeAllocate: Allocate() found the pool used up
+    QUEUE_STAT_FREE_LIST_CAS_FAILURE, // FreeAllocate: lost CAS on the free list head
+    QUEUE_STAT_GROW, // FreeAllocate: slabs added by an elastic pool
+    QUEUE_STAT_COUNT,
+};
+
+struct QueueStatsSnapshot {
+    uint64_t counters[QUEUE_STAT_COUNT] = {};
+    // FreeAllocate: fewest free nodes seen after an Allocate(), SIZE_MAX if never tracked
+    size_t pool_low_water = SIZE_MAX;
+
+    uint64_t operator[](QUEUE_STAT stat) const {
+        return counters[stat];
+    }
+
+    // merge the snapshot of another part, e.g. a LinkedQueue and its node pool
+    QueueStatsSnapshot &operator+=(const QueueStatsSnapshot &other) {
+        for(size_t i = 0; i < QUEUE_STAT_COUNT; ++i) {
+            counters[i] += other.counters[i];
+        }
+
+        if(other.pool_low_water < pool_low_water) {
+            pool_low_water = other.pool_low_water;
+        }
+
+        return *this;
+    }
+
+    static const char *Name(QUEUE_STAT stat) {
+        static const char *names[QUEUE_STAT_COUNT] = {
+            "push", "pop", "full", "empty", "write_cas_failure", "read_cas_failure", "slot_yield",
+            "allocate", "deallocate", "allocate_failure", "free_list_cas_failure", "grow",
+        };
+
+        return names[stat];
+    }
+};
+
+// counting disabled, the default of every Options::Stats
+struct QueueNoStats {
+    static constexpr bool Enabled = false;
+
+    void Add(QUEUE_STAT stat, uint64_t n = 1u) {}
+
+    void TrackPool(ptrdiff_t in_use_delta, size_t capacity) {}
+
+    QueueStatsSnapshot Snapshot() const {
+        return QueueStatsSnapshot();
+    }
+};
+
+// threads beyond Shards share shards, counts stay exact but their lines are shared
+template<size_t Shards = 16>
+class QueueStats {
+public:
+    static constexpr bool Enabled = true;
+
+    void Add(QUEUE_STAT stat, uint64_t n = 1u) {
+        Shard *shard = &m_shards[ThreadOrdinal() % Shards];
+
+        shard->counters[stat].fetch_add(n, std::memory_order_relaxed);
+    }
+
+    // nodes in use move by in_use_delta, capacity is the pool size right now.
+    // the in use count is shared by all threads, only pools with stats pay for it
+    void TrackPool(ptrdiff_t in_use_delta, size_t capacity) {
+        size_t in_use = m_in_use.fetch_add((size_t)in_use_delta, std::memory_order_relaxed) + (size_t)in_use_delta;
+
+        if(in_use_delta <= 0) {
+            return;
+        }
+
+        size_t free = capacity > in_use ? capacity - in_use : 0;
+        size_t low_water = m_pool_low_water.load(std::memory_order_relaxed);
+
+        while(free < low_water && !m_pool_low_water.compare_exchange_weak(low_water, free, std::memory_order_relaxed));
+    }
+
+    // counters keep running, a snapshot is not atomic across counters
+    QueueStatsSnapshot Snapshot() const {
+        QueueStatsSnapshot snapshot;
+
+        for(size_t i = 0; i < Shards; ++i) {
+            for(size_t j = 0; j < QUEUE_STAT_COUNT; ++j) {
+                snapshot.counters[j] += m_shards[i].counters[j].load(std::memory_order_relaxed);
+            }
+        }
+
+        snapshot.pool_low_water = m_pool_low_water.load(std::memory_order_relaxed);
+
+        return snapshot;
+    }
+
+private:
+    struct alignas(CacheLineSize) Shard {
+        std::atomic<uint64_t> counters[QUEUE_STAT_COUNT] = {};
+    };
+
+    Shard m_shards[Shards];
+
+    alignas(CacheLineSize) std::atomic<size_t> m_in_use = ATOMIC_VAR_INIT(0);
+    std::atomic<size_t> m_pool_low_water = ATOMIC_VAR_INIT(SIZE_MAX);
+};
+
+#endif
@@ -0,0 +1,147 @@
+#include "fixed_queue.h"
+#include "linked_queue.h"
+
+#include <vector>
+#include <thread>
+
+#include <signal.h>
+
+// counters against the callers' own counts: push/pop and full/empty returns must match
+// exactly, the node pool must have handed out one node per element still queued plus
+// the "empty node", and its low-water mark must lie within the pool. queues without
+// Options::Stats report zeros
+
+static constexpr int Pushers = 2;
+static constexpr int Popers = 2;
+
+static std::atomic<int> stop = ATOMIC_VAR_INIT(0);
+
+static void sig_handler(int sig) {
+    stop.store(1, std::memory_order_relaxed);
+}
+
+struct Counts {
+    std::atomic<unsigned long long> push = ATOMIC_VAR_INIT(0);
+    std::atomic<unsigned long long> pop = ATOMIC_VAR_INIT(0);
+    std::atomic<unsigned long long> full = ATOMIC_VAR_INIT(0);
+    std::atomic<unsigned long long> empty = ATOMIC_VAR_INIT(0);
+};
+
+template<typename Queue>
+static void run(Queue *q, Counts *counts) {
+    std::vector<std::thread> threads;
+
+    for(int i = 0; i < Pushers; ++i) {
+        threads.emplace_back([q, counts]() {
+                unsigned long v = 0;
+
+                while(!stop.load(std::memory_order_relaxed)) {
+                    if(q->Push(v++)) {
+                        counts->push.fetch_add(1u, std::memory_order_relaxed);
+                    } else {
+                        counts->full.fetch_add(1u, std::memory_order_relaxed);
+                    }
+                }
+                });
+    }
+
+    for(int i = 0; i < Popers; ++i) {
+        threads.emplace_back([q, counts]() {
+                unsigned long v;
+
+                while(!stop.load(std::memory_order_relaxed)) {
+                    if(q->Pop(&v)) {
+                        counts->pop.fetch_add(1u, std::memory_order_relaxed);
+                    } else {
+                        counts->empty.fetch_add(1u, std::memory_order_relaxed);
+                    }
+                }
+                });
+    }
+
+    for(size_t i = 0; i < threads.size(); ++i) {
+        threads[i].join();
+    }
+}
+
+static void print(const char *name, const QueueStatsSnapshot &snapshot) {
+    printf("%s:", name);
+
+    for(int i = 0; i < QUEUE_STAT_COUNT; ++i) {
+        printf(" %s=%llu", QueueStatsSnapshot::Name((QUEUE_STAT)i), (unsigned long long)snapshot[(QUEUE_STAT)i]);
+    }
+
+    printf(" pool_low_water=%lu\n", (unsigned long)snapshot.pool_low_water);
+}
+
+static int check(const char *name, const QueueStatsSnapshot &snapshot, const Counts &counts) {
+    print(name, snapshot);
+
+    if(snapshot[QUEUE_STAT_PUSH] != counts.push.load() || snapshot[QUEUE_STAT_POP] != counts.pop.load() ||
+            snapshot[QUEUE_STAT_FULL] != counts.full.load() || snapshot[QUEUE_STAT_EMPTY] != counts.empty.load()) {
+        fprintf(stderr, "%s: counters differ from push=%llu, pop=%llu, full=%llu, empty=%llu\n",
+                name, counts.push.load(), counts.pop.load(), counts.full.load(), counts.empty.load());
+        return 1;
+    }
+
+    return 0;
+}
+
+int main() {
+    signal(SIGINT, sig_handler);
+    signal(SIGTERM, sig_handler);
+
+    static constexpr size_t Capacity = 1000;
+
+    FixedQueue<unsigned long, Capacity, FixedQueueStatsOptions> fq;
+    LinkedQueue<unsigned long, true, LinkedQueueStatsOptions> lq(Capacity);
+    FixedQueue<unsigned long, Capacity> plain_fq;
+    LinkedQueue<unsigned long> plain_lq(Capacity);
+
+    Counts fq_counts;
+    Counts lq_counts;
+    Counts plain_counts;
+
+    std::thread t1([&]() {
+            run(&fq, &fq_counts);
+            });
+
+    std::thread t2([&]() {
+            run(&plain_fq, &plain_counts);
+            });
+
+    run(&lq, &lq_counts);
+    t1.join();
+    t2.join();
+
+    int ret = check("fixed_queue", fq.GetStats(), fq_counts);
+
+    QueueStatsSnapshot lq_stats = lq.GetStats();
+    ret |= check("linked_queue", lq_stats, lq_counts);
+
+    // nodes of queued elements and the "empty node" are still out
+    unsigned long long queued = lq_counts.push.load() - lq_counts.pop.load();
+
+    if(lq_stats[QUEUE_STAT_ALLOCATE] - lq_stats[QUEUE_STAT_DEALLOCATE] != queued + 1u ||
+            lq_stats[QUEUE_STAT_ALLOCATE_FAILURE] != lq_counts.full.load() ||
+            lq_stats.pool_low_water > Capacity) {
+        fprintf(stderr, "linked_queue: pool counters are inconsistent, queued=%llu\n", queued);
+        ret = 1;
+    }
+
+    QueueStatsSnapshot plain_stats = plain_fq.GetStats();
+    plain_stats += plain_lq.GetStats();
+    print("plain", plain_stats);
+
+    for(int i = 0; i < QUEUE_STAT_COUNT; ++i) {
+        if(plain_stats[(QUEUE_STAT)i]) {
+            fprintf(stderr, "plain: %s is counted\n", QueueStatsSnapshot::Name((QUEUE_STAT)i));
+            ret = 1;
+        }
+    }
+
+    lq.Clear();
+    plain_lq.Clear();
+
+    return ret;
+}
@@ -0,0 +1,301 @@
+#ifndef __SHARDED_QUEUE_H__
+#define __SHARDED_QUEUE_H__
+
+#include "mapped_memory.h"
+
+#include <vector>
+#include <new>
+#include <utility>
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sched.h>
+#include <unistd.h>
+
+enum SHARDED_QUEUE_SHARD_BY {
+    SHARDED_QUEUE_SHARD_BY_NODE = 0, // one shard per NUMA node
+    SHARDED_QUEUE_SHARD_BY_CPU_GROUP, // one shard per Options::CpusPerGroup cpus
+};
+
+struct ShardedQueueDefaultOptions {
+    static constexpr int ShardBy = SHARDED_QUEUE_SHARD_BY_NODE;
+    static constexpr size_t CpusPerGroup = 8;
+    // true: a producer pushes to the shard of the cpu it first pushed on, for its whole
+    // life, so its elements stay in push order for any one consumer (given the shard
+    // queue keeps per-producer order). false: every Push() goes to the shard of the cpu
+    // it runs on right now, a migrated producer's elements may be popped out of order
+    static constexpr bool ProducerFifo = true;
+    // Pop() tries the other shards when the local one is empty
+    static constexpr bool Steal = true;
+};
+
+struct ShardedQueueCpuGroupOptions : ShardedQueueDefaultOptions {
+    static constexpr int ShardBy = SHARDED_QUEUE_SHARD_BY_CPU_GROUP;
+};
+
+// fills *cpus from a sysfs cpu list like "0-3,8-11", return false if it can not be read
+static inline bool ShardedQueueReadCpuList(const char *path, std::vector<int> *cpus) {
+    FILE *f = fopen(path, "r");
+
+    if(!f) {
+        return false;
+    }
+
+    char buffer[4096];
+    bool ok = fgets(buffer, sizeof(buffer), f) != nullptr;
+    fclose(f);
+
+    for(char *p = buffer; ok && *p && *p != '\n'; ) {
+        char *end;
+        long first = strtol(p, &end, 10);
+        long last = first;
+
+        if(end == p) {
+            break;
+        }
+
+        if(*end == '-') {
+            p = end + 1;
+            last = strtol(p, &end, 10);
+        }
+
+        for(long cpu = first; cpu <= last; ++cpu) {
+            cpus->push_back((int)cpu);
+        }
+
+        p = *end == ',' ? end + 1 : end;
+    }
+
+    return ok;
+}
+
+// the cpu this thread first asked from, a producer's home under Options::ProducerFifo
+static inline int ShardedQueueHomeCpu() {
+    thread_local int cpu = sched_getcpu();
+
+    return cpu;
+}
+
+// one inner queue per NUMA node (or cpu group), its slots or nodes and its cursors
+// mmap-ed on that node. producers push to their local shard, consumers pop their local
+// shard first and steal from the others, so cursor CAS stay on one node as long as
+// there is local work. order is per shard only, see Options::ProducerFifo.
+// Queue is a queue with a (capacity, MappedMemoryOptions) constructor, Push(args ...)
+// and Pop(out): FixedQueue<ElementType, FixedQueueDynamicCapacity, ...> or LinkedQueue.
+// with ProducerFifo, pick a Queue that keeps per-producer order with several writers
+// and readers, i.e. not FIXED_QUEUE_PROTOCOL_RWREF
+template<typename Queue, typename Options = ShardedQueueDefaultOptions>
+class ShardedQueue {
+public:
+    // shard_capacity is the capacity of each shard. shard_count 0 takes one shard per
+    // node or cpu group, otherwise the topology shards are folded onto shard_count
+    explicit ShardedQueue(size_t shard_capacity, size_t shard_count = 0) {
+        std::vector<int> shard_nodes;
+
+        ReadTopology(&shard_nodes);
+
+        if(!shard_count) {
+            shard_count = shard_nodes.size();
+        }
+
+        for(size_t i = 0; i < m_cpu_shard.size(); ++i) {
+            m_cpu_shard[i] %= shard_count;
+        }
+
+        m_shards = new Shard[shard_count];
+        m_shard_count = shard_count;
+
+        for(size_t i = 0; i < shard_count; ++i) {
+            MappedMemoryOptions memory_options;
+            memory_options.numa_node = shard_nodes[i % shard_nodes.size()];
+
+            void *p = MappedMemoryAllocate(sizeof(Queue), memory_options, &m_shards[i].mapped_bytes);
+
+            if(!p) {
+                Destroy();
+                throw std::bad_alloc();
+            }
+
+            try {
+                m_shards[i].queue = new (p) Queue(shard_capacity, memory_options);
+            } catch(...) {
+                MappedMemoryFree(p, m_shards[i].mapped_bytes);
+                Destroy();
+                throw;
+            }
+        }
+    }
+
+    ~ShardedQueue() {
+        Destroy();
+    }
+
+    template<typename ... Args>
+    bool Push(Args && ... args) {
+        size_t shard = ShardOf(Options::ProducerFifo ? ShardedQueueHomeCpu() : sched_getcpu());
+
+        if(m_shards[shard].queue->Push(std::forward<Args>(args) ...)) {
+            return true;
+        }
+
+        if constexpr (!Options::ProducerFifo) {
+            // local shard is full, order is not kept anyway
+            for(size_t i = 1; i < m_shard_count; ++i) {
+                if(m_shards[(shard + i) % m_shard_count].queue->Push(std::forward<Args>(args) ...)) {
+                    return true;
+                }
+            }
+        }
+
+        return false;
+    }
+
+    // push to a given shard, for producers that place their elements themselves
+    template<typename ... Args>
+    bool PushTo(size_t shard, Args && ... args) {
+        return m_shards[shard % m_shard_count].queue->Push(std::forward<Args>(args) ...);
+    }
+
+    template<typename OutType>
+    bool Pop(OutType *out) {
+        size_t shard = LocalShard();
+
+        if(m_shards[shard].queue->Pop(out)) {
+            return true;
+        }
+
+        if constexpr (Options::Steal) {
+            for(size_t i = 1; i < m_shard_count; ++i) {
+                if(m_shards[(shard + i) % m_shard_count].queue->Pop(out)) {
+                    return true;
+                }
+            }
+        }
+
+        return false;
+    }
+
+    // pop from a given shard only
+    template<typename OutType>
+    bool PopFrom(size_t shard, OutType *out) {
+        return m_shards[shard % m_shard_count].queue->Pop(out);
+    }
+
+    // LinkedQueue shards must be cleared before the destructor, see ~LinkedQueue()
+    void Clear() {
+        for(size_t i = 0; i < m_shard_count; ++i) {
+            m_shards[i].queue->Clear();
+        }
+    }
+
+    // shard of the cpu the calling thread runs on
+    size_t LocalShard() const {
+        return ShardOf(sched_getcpu());
+    }
+
+    size_t GetShardCount() const {
+        return m_shard_count;
+    }
+
+    Queue &GetShard(size_t shard) {
+        return *m_shards[shard % m_shard_count].queue;
+    }
+
+private:
+    ShardedQueue(const ShardedQueue &);
+    ShardedQueue(ShardedQueue &&);
+    ShardedQueue &operator=(const ShardedQueue &);
+    ShardedQueue &operator=(ShardedQueue &&);
+
+    // the Queue object lives on its own mapped pages, the array of these is read only
+    struct Shard {
+        Queue *queue = nullptr;
+        size_t mapped_bytes = 0;
+    };
+
+    size_t ShardOf(int cpu) const {
+        if(cpu < 0) {
+            cpu = 0;
+        }
+
+        return m_cpu_shard[(size_t)cpu % m_cpu_shard.size()];
+    }
+
+    // m_cpu_shard maps cpu -> topology shard, *shard_nodes receives the NUMA node of
+    // every topology shard. no sysfs: one shard on any node
+    void ReadTopology(std::vector<int> *shard_nodes) {
+        long configured = sysconf(_SC_NPROCESSORS_CONF);
+        size_t cpu_count = configured > 0 ? (size_t)configured : 1u;
+        std::vector<int> cpu_node(cpu_count, MAPPED_MEMORY_NODE_ANY);
+        std::vector<int> nodes;
+
+        if(ShardedQueueReadCpuList("/sys/devices/system/node/online", &nodes)) {
+            for(size_t i = 0; i < nodes.size(); ++i) {
+                char path[128];
+                std::vector<int> cpus;
+
+                snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", nodes[i]);
+                ShardedQueueReadCpuList(path, &cpus);
+
+                for(size_t j = 0; j < cpus.size(); ++j) {
+                    if((size_t)cpus[j] < cpu_count) {
+                        cpu_node[cpus[j]] = nodes[i];
+                    }
+                }
+            }
+        }
+
+        m_cpu_shard.assign(cpu_count, 0);
+
+        if constexpr (Options::ShardBy == SHARDED_QUEUE_SHARD_BY_CPU_GROUP) {
+            static_assert(Options::CpusPerGroup > 0, "a cpu group needs a cpu");
+
+            for(size_t cpu = 0; cpu < cpu_count; ++cpu) {
+                m_cpu_shard[cpu] = cpu / Options::CpusPerGroup;
+
+                if(cpu % Options::CpusPerGroup == 0) {
+                    // storage of a group goes to the node of its first cpu
+                    shard_nodes->push_back(cpu_node[cpu]);
+                }
+            }
+        } else {
+            // node ids may have holes, shards are numbered densely
+            for(size_t cpu = 0; cpu < cpu_count; ++cpu) {
+                size_t shard = 0;
+
+                while(shard < shard_nodes->size() && (*shard_nodes)[shard] != cpu_node[cpu]) {
+                    ++shard;
+                }
+
+                if(shard == shard_nodes->size()) {
+                    shard_nodes->push_back(cpu_node[cpu]);
+                }
+
+                m_cpu_shard[cpu] = shard;
+            }
+        }
+    }
+
+    void Destroy() {
+        if(!m_shards) {
+            return;
+        }
+
+        for(size_t i = 0; i < m_shard_count; ++i) {
+            if(m_shards[i].queue) {
+                m_shards[i].queue->~Queue();
+                MappedMemoryFree(m_shards[i].queue, m_shards[i].mapped_bytes);
+            }
+        }
+
+        delete[] m_shards;
+        m_shards = nullptr;
+    }
+
+    Shard *m_shards = nullptr;
+    size_t m_shard_count = 0;
+    std::vector<size_t> m_cpu_shard;
+};
+
+#endif
@@ -0,0 +1,143 @@
+#include "sharded_queue.h"
+#include "fixed_queue.h"
+#include "linked_queue.h"
+
+#include <vector>
+#include <thread>
+
+#include <signal.h>
+
+// pushers 0 and 1 place their elements on shards by PushTo(), the others go through
+// Push() to their home shard. poppers drain their local shard and steal the rest, so
+// with more shards than nodes most pops are steals. every popper checks each
+// producer's counters increase (ProducerFifo) and every counter is popped once
+
+static constexpr int Pushers = 4;
+static constexpr int Popers = 3;
+static constexpr size_t Shards = 4;
+static constexpr size_t ShardCapacity = 1000;
+
+static std::atomic<int> stop = ATOMIC_VAR_INIT(0);
+
+static void sig_handler(int sig) {
+    stop.store(1, std::memory_order_relaxed);
+}
+
+struct Element {
+    unsigned long producer = 0;
+    unsigned long counter = 0;
+};
+
+template<typename ShardedQueueType>
+static int run(const char *name) {
+    ShardedQueueType q(ShardCapacity, Shards);
+
+    std::atomic<unsigned long long> push_success(0);
+    std::atomic<unsigned long long> pop_success(0);
+    std::atomic<unsigned long long> errors(0);
+    std::vector<unsigned long> pushed(Pushers, 0);
+    std::vector<std::vector<unsigned long>> popped(Popers);
+
+    std::vector<std::thread> threads;
+
+    for(int i = 0; i < Pushers; ++i) {
+        threads.emplace_back([&, i]() {
+                Element e;
+                e.producer = i;
+
+                while(!stop.load(std::memory_order_relaxed)) {
+                    // one producer stays on one shard, or its order is lost
+                    bool ok = i < 2 ? q.PushTo(i, e) : q.Push(e);
+
+                    if(ok) {
+                        ++e.counter;
+                        push_success.fetch_add(1u, std::memory_order_relaxed);
+                    } else {
+                        std::this_thread::yield();
+                    }
+                }
+
+                pushed[i] = e.counter;
+                });
+    }
+
+    for(int i = 0; i < Popers; ++i) {
+        threads.emplace_back([&, i]() {
+                std::vector<long> last(Pushers, -1);
+                Element e;
+
+                while(!stop.load(std::memory_order_relaxed)) {
+                    if(!q.Pop(&e)) {
+                        continue;
+                    }
+
+                    if(e.producer >= (unsigned long)Pushers || (long)e.counter <= last[e.producer]) {
+                        errors.fetch_add(1u, std::memory_order_relaxed);
+                        continue;
+                    }
+
+                    last[e.producer] = (long)e.counter;
+                    popped[i].push_back(e.producer << 48 | e.counter);
+                    pop_success.fetch_add(1u, std::memory_order_relaxed);
+                }
+                });
+    }
+
+    for(size_t i = 0; i < threads.size(); ++i) {
+        threads[i].join();
+    }
+
+    // the rest, every counter of every producer exactly once
+    std::vector<std::vector<char>> seen(Pushers);
+
+    for(int i = 0; i < Pushers; ++i) {
+        seen[i].assign(pushed[i], 0);
+    }
+
+    Element e;
+    unsigned long long left = 0;
+
+    for(size_t shard = 0; shard < q.GetShardCount(); ++shard) {
+        while(q.PopFrom(shard, &e)) {
+            popped[0].push_back(e.producer << 48 | e.counter);
+            ++left;
+        }
+    }
+
+    for(int i = 0; i < Popers; ++i) {
+        for(size_t j = 0; j < popped[i].size(); ++j) {
+            unsigned long producer = popped[i][j] >> 48;
+            unsigned long counter = popped[i][j] & 0xffffffffffffUL;
+
+            if(counter >= pushed[producer] || seen[producer][counter]++) {
+                errors.fetch_add(1u, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    printf("%s shards=%lu push_success=%llu, pop_success=%llu, left=%llu, errors=%llu\n",
+            name, (unsigned long)q.GetShardCount(), push_success.load(), pop_success.load(), left, errors.load());
+
+    if(push_success.load() != pop_success.load() + left || errors.load()) {
+        fprintf(stderr, "%s FAILED\n", name);
+        return 1;
+    }
+
+    return 0;
+}
+
+int main() {
+    signal(SIGINT, sig_handler);
+    signal(SIGTERM, sig_handler);
+
+    int fixed_ret = 0;
+
+    std::thread t([&fixed_ret]() {
+            fixed_ret = run<ShardedQueue<FixedQueue<Element, FixedQueueDynamicCapacity, FixedQueueSequenceOptions>>>("fixed_queue");
+            });
+
+    int linked_ret = run<ShardedQueue<LinkedQueue<Element>, ShardedQueueCpuGroupOptions>>("linked_queue");
+    t.join();
+
+    return fixed_ret | linked_ret;
+}
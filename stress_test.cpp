@@ -0,0 +1,547 @@
+#include "fixed_queue.h"
+#include "linked_queue.h"
+#include "intrusive_queue.h"
+#include "sharded_queue.h"
+#include "work_stealing_deque.h"
+#include "broadcast_ring.h"
+#include "free_allocate.h"
+
+#include <vector>
+#include <thread>
+#include <memory>
+#include <algorithm>
+
+#include <stdlib.h>
+
+// usage: stress_test.out [ops_per_producer]
+//
+// fixed operation counts, exit code 0 only if every check passed, so it runs unattended
+// and under ASan/TSan (make check).
+// FIFO runs: every producer pushes counters 0..n-1, consumers pop until all are out.
+// each element is popped exactly once (no loss, no duplicate), each consumer sees every
+// producer's counters increasing, and the heap payload arrives intact. the RWREF slot
+// protocol with several writers and readers does not keep that order (a writer of the
+// next lap may fill a slot before a stalled writer of this lap), its runs report
+// order_errors without failing.
+// bound runs: rounds of producers racing to fill an empty FixedQueue, the queue never
+// holds more than its capacity, also when its ring is rounded up past it.
+// steal runs: the owner pushes 0..n-1 into a WorkStealingDeque that starts small and
+// pops some back, thieves steal the rest, each value is taken exactly once.
+// broadcast runs: producers push counters 0..n-1 into a BroadcastRing, every subscriber
+// sees each producer's counters in order, all of them when writers block, and popped
+// plus overruns adds up to all pushed when they overwrite.
+// recycle runs: nodes go round FreeAllocate -> FixedQueue -> FreeAllocate as in
+// free_allocate_test_3.cpp, afterwards exactly capacity distinct nodes can be allocated.
+
+struct Element {
+    Element() = default;
+
+    Element(unsigned long p, unsigned long c) : producer(p), counter(c), payload{(int)p, (int)c} {}
+
+    unsigned long producer = 0;
+    unsigned long counter = 0;
+    std::vector<int> payload;
+};
+
+struct IntrusiveElement : IntrusiveQueueHook {
+    Element elem;
+};
+
+// IntrusiveQueue owns nothing, the adapter gives it heap objects
+template<bool MultiReader>
+class IntrusiveAdapter {
+public:
+    ~IntrusiveAdapter() {
+        m_queue.ClearF([](IntrusiveElement *e) {
+                delete e;
+                });
+    }
+
+    bool Push(Element &&elem) {
+        IntrusiveElement *e = new IntrusiveElement();
+        e->elem = std::move(elem);
+        m_queue.Push(e);
+        return true;
+    }
+
+    bool Pop(Element *out) {
+        IntrusiveElement *e = m_queue.Pop();
+
+        if(!e) {
+            return false;
+        }
+
+        *out = std::move(e->elem);
+        delete e;
+        return true;
+    }
+
+private:
+    IntrusiveQueue<IntrusiveElement, MultiReader> m_queue;
+};
+
+template<typename Queue>
+static bool RunFifo(const char *name, Queue *q, int producers, int consumers, unsigned long n, bool strict_order) {
+    std::vector<std::atomic<unsigned char>> seen(producers * n);
+    std::atomic<unsigned long long> popped(0);
+    std::atomic<unsigned long long> errors(0);
+    std::atomic<unsigned long long> order_errors(0);
+    unsigned long long total = (unsigned long long)producers * n;
+
+    for(size_t i = 0; i < seen.size(); ++i) {
+        seen[i].store(0, std::memory_order_relaxed);
+    }
+
+    std::vector<std::thread> threads;
+
+    for(int i = 0; i < producers; ++i) {
+        threads.emplace_back([&, i]() {
+                for(unsigned long c = 0; c < n; ) {
+                    if(q->Push(Element(i, c))) {
+                        ++c;
+                    } else {
+                        std::this_thread::yield();
+                    }
+                }
+                });
+    }
+
+    for(int i = 0; i < consumers; ++i) {
+        threads.emplace_back([&]() {
+                std::vector<long> last(producers, -1);
+                Element e;
+
+                while(popped.load(std::memory_order_relaxed) < total) {
+                    if(!q->Pop(&e)) {
+                        std::this_thread::yield();
+                        continue;
+                    }
+
+                    popped.fetch_add(1u, std::memory_order_relaxed);
+
+                    if(e.producer >= (unsigned long)producers || e.counter >= n) {
+                        errors.fetch_add(1u, std::memory_order_relaxed);
+                        continue;
+                    }
+
+                    if((long)e.counter <= last[e.producer]) {
+                        // FIFO per producer
+                        order_errors.fetch_add(1u, std::memory_order_relaxed);
+                    }
+
+                    last[e.producer] = (long)e.counter;
+
+                    if(e.payload.size() != 2u || e.payload[0] != (int)e.producer || e.payload[1] != (int)e.counter) {
+                        errors.fetch_add(1u, std::memory_order_relaxed);
+                    }
+
+                    if(seen[e.producer * n + e.counter].fetch_add(1u, std::memory_order_relaxed)) {
+                        // duplicate
+                        errors.fetch_add(1u, std::memory_order_relaxed);
+                    }
+                }
+                });
+    }
+
+    for(size_t i = 0; i < threads.size(); ++i) {
+        threads[i].join();
+    }
+
+    unsigned long long lost = 0;
+
+    for(size_t i = 0; i < seen.size(); ++i) {
+        lost += seen[i].load(std::memory_order_relaxed) == 0;
+    }
+
+    Element e;
+    unsigned long long extra = 0;
+
+    while(q->Pop(&e)) {
+        ++extra;
+    }
+
+    bool ok = !errors.load() && !lost && !extra && (!strict_order || !order_errors.load());
+
+    printf("%s %-32s producers=%d consumers=%d popped=%llu errors=%llu order_errors=%llu%s lost=%llu extra=%llu\n",
+            ok ? "PASS" : "FAIL", name, producers, consumers, popped.load(), errors.load(), order_errors.load(),
+            strict_order ? "" : "(allowed)", lost, extra);
+    fflush(stdout);
+
+    return ok;
+}
+
+// StrictOrder = false: only loss, duplicates and payloads fail the run
+template<typename Queue, bool StrictOrder = true, typename ... Args>
+static bool Fifo(const char *name, int producers, int consumers, unsigned long n, Args && ... args) {
+    std::unique_ptr<Queue> q = std::make_unique<Queue>(std::forward<Args>(args) ...);
+
+    return RunFifo(name, q.get(), producers, consumers, n, StrictOrder);
+}
+
+// every round the producers push until the queue refuses, then it is drained and counted
+template<typename Queue>
+static bool Bound(const char *name, int producers, unsigned long rounds, size_t capacity) {
+    std::unique_ptr<Queue> q = std::make_unique<Queue>();
+    std::atomic<unsigned long> round(0);
+    std::atomic<int> finished(0);
+    unsigned long long overflows = 0;
+    size_t most = 0;
+
+    std::vector<std::thread> threads;
+
+    for(int i = 0; i < producers; ++i) {
+        threads.emplace_back([&, i]() {
+                for(unsigned long r = 1; r <= rounds; ++r) {
+                    while(round.load(std::memory_order_acquire) < r) {
+                        std::this_thread::yield();
+                    }
+
+                    for(unsigned long c = 0; q->Push(Element(i, c)); ++c);
+
+                    finished.fetch_add(1, std::memory_order_acq_rel);
+                }
+                });
+    }
+
+    for(unsigned long r = 1; r <= rounds; ++r) {
+        finished.store(0, std::memory_order_relaxed);
+        round.store(r, std::memory_order_release);
+
+        while(finished.load(std::memory_order_acquire) < producers) {
+            std::this_thread::yield();
+        }
+
+        Element e;
+        size_t size = 0;
+
+        while(q->Pop(&e)) {
+            ++size;
+        }
+
+        overflows += size > capacity;
+        most = size > most ? size : most;
+    }
+
+    for(size_t i = 0; i < threads.size(); ++i) {
+        threads[i].join();
+    }
+
+    bool ok = !overflows;
+
+    printf("%s %-32s producers=%d rounds=%lu capacity=%lu most=%lu overflows=%llu\n",
+            ok ? "PASS" : "FAIL", name, producers, rounds, (unsigned long)capacity, (unsigned long)most, overflows);
+    fflush(stdout);
+
+    return ok;
+}
+
+struct FixedQueueParkOptions : FixedQueueSequenceOptions {
+    using Backoff = BackoffSpinPark<>;
+};
+
+struct FixedQueueTicketRoundUpOptions : FixedQueueTicketOptions {
+    static constexpr bool RoundUpCapacity = true;
+};
+
+struct FixedQueueSequenceRoundUpOptions : FixedQueueSequenceOptions {
+    static constexpr bool RoundUpCapacity = true;
+};
+
+struct LinkedQueuePauseOptions : LinkedQueueDefaultOptions {
+    using Backoff = BackoffExponentialPause<>;
+};
+
+template<typename Options>
+static bool Steal(const char *name, int thieves, unsigned long n) {
+    std::unique_ptr<WorkStealingDeque<unsigned long, Options>> deque = std::make_unique<WorkStealingDeque<unsigned long, Options>>(64);
+    std::vector<std::atomic<unsigned char>> seen(n);
+    std::atomic<int> owner_done(0);
+    std::atomic<unsigned long long> errors(0);
+    unsigned long long full = 0;
+
+    for(size_t i = 0; i < seen.size(); ++i) {
+        seen[i].store(0, std::memory_order_relaxed);
+    }
+
+    auto take = [&](unsigned long v) {
+        if(v >= n || seen[v].fetch_add(1u, std::memory_order_relaxed)) {
+            errors.fetch_add(1u, std::memory_order_relaxed);
+        }
+    };
+
+    std::vector<std::thread> threads;
+
+    for(int i = 0; i < thieves; ++i) {
+        threads.emplace_back([&]() {
+                unsigned long v;
+
+                for(;;) {
+                    if(deque->Steal(&v)) {
+                        take(v);
+                    } else if(owner_done.load(std::memory_order_acquire)) {
+                        break;
+                    }
+                }
+                });
+    }
+
+    unsigned long v;
+
+    for(unsigned long value = 0; value < n; ) {
+        if(deque->Push(value)) {
+            ++value;
+        } else {
+            ++full;
+        }
+
+        if(value % 4 == 0 && deque->Pop(&v)) {
+            take(v);
+        }
+    }
+
+    while(deque->Pop(&v)) {
+        take(v);
+    }
+
+    owner_done.store(1, std::memory_order_release);
+
+    for(size_t i = 0; i < threads.size(); ++i) {
+        threads[i].join();
+    }
+
+    unsigned long long lost = 0;
+
+    for(size_t i = 0; i < seen.size(); ++i) {
+        lost += seen[i].load(std::memory_order_relaxed) == 0;
+    }
+
+    bool ok = !errors.load() && !lost;
+
+    printf("%s %-32s thieves=%d errors=%llu lost=%llu full=%llu capacity=%lu\n",
+            ok ? "PASS" : "FAIL", name, thieves, errors.load(), lost, full, (unsigned long)deque->GetCapacity());
+    fflush(stdout);
+
+    return ok;
+}
+
+struct BroadcastElement {
+    unsigned long producer;
+    unsigned long counter;
+};
+
+template<typename Options>
+static bool Broadcast(const char *name, int producers, int subscribers, unsigned long n) {
+    constexpr bool Overwrite = Options::SlowReader == BROADCAST_RING_OVERWRITE;
+
+    std::unique_ptr<BroadcastRing<BroadcastElement, Options>> ring = std::make_unique<BroadcastRing<BroadcastElement, Options>>(256);
+    std::vector<size_t> ids(subscribers);
+    std::vector<unsigned long long> popped(subscribers, 0);
+    std::atomic<int> producers_done(0);
+    std::atomic<unsigned long long> errors(0);
+
+    for(int i = 0; i < subscribers; ++i) {
+        if(!ring->Subscribe(&ids[i])) {
+            errors.fetch_add(1u, std::memory_order_relaxed);
+        }
+    }
+
+    std::vector<std::thread> threads;
+
+    for(int i = 0; i < subscribers; ++i) {
+        threads.emplace_back([&, i]() {
+                std::vector<long> last(producers, -1);
+                BroadcastElement e;
+
+                for(;;) {
+                    bool done = producers_done.load(std::memory_order_acquire);
+
+                    if(ring->Pop(ids[i], &e)) {
+                        if(e.producer >= (unsigned long)producers || (long)e.counter <= last[e.producer] ||
+                                (!Overwrite && (long)e.counter != last[e.producer] + 1)) {
+                            errors.fetch_add(1u, std::memory_order_relaxed);
+                        }
+
+                        if(e.producer < (unsigned long)producers) {
+                            last[e.producer] = (long)e.counter;
+                        }
+
+                        ++popped[i];
+                    } else if(done) {
+                        break;
+                    }
+                }
+                });
+    }
+
+    std::vector<std::thread> writers;
+
+    for(int i = 0; i < producers; ++i) {
+        writers.emplace_back([&, i]() {
+                for(unsigned long counter = 0; counter < n; ) {
+                    if(ring->Push(BroadcastElement{(unsigned long)i, counter})) {
+                        ++counter;
+                    } else {
+                        std::this_thread::yield();
+                    }
+                }
+                });
+    }
+
+    for(size_t i = 0; i < writers.size(); ++i) {
+        writers[i].join();
+    }
+
+    producers_done.store(1, std::memory_order_release);
+
+    for(size_t i = 0; i < threads.size(); ++i) {
+        threads[i].join();
+    }
+
+    unsigned long long lost = 0;
+    unsigned long long overruns = 0;
+
+    for(int i = 0; i < subscribers; ++i) {
+        unsigned long long o = ring->GetOverruns(ids[i]);
+
+        overruns += o;
+        lost += popped[i] + o != (unsigned long long)producers * n;
+    }
+
+    bool ok = !errors.load() && !lost;
+
+    printf("%s %-32s producers=%d subscribers=%d errors=%llu lost=%llu overruns=%llu\n",
+            ok ? "PASS" : "FAIL", name, producers, subscribers, errors.load(), lost, overruns);
+    fflush(stdout);
+
+    return ok;
+}
+
+static constexpr unsigned long RecycleMagic = 0x5eed5eedUL;
+
+template<typename FreeAllocateType>
+static bool Recycle(const char *name, int threads, unsigned long n) {
+    using ElementFreeNode = typename FreeAllocateType::ElementFreeNode;
+
+    static constexpr size_t Capacity = 1000;
+
+    std::unique_ptr<FreeAllocateType> free_allocate = std::make_unique<FreeAllocateType>(Capacity);
+    std::unique_ptr<FixedQueue<ElementFreeNode *, FixedQueueDynamicCapacity>> fq =
+        std::make_unique<FixedQueue<ElementFreeNode *, FixedQueueDynamicCapacity>>(Capacity);
+
+    std::atomic<unsigned long long> errors(0);
+    std::vector<std::thread> workers;
+
+    for(int i = 0; i < threads; ++i) {
+        workers.emplace_back([&, i]() {
+                for(unsigned long k = 0; k < n; ++k) {
+                    ElementFreeNode *elem_node = free_allocate->Allocate();
+
+                    if(elem_node) {
+                        free_allocate->ConstructAt(elem_node, (unsigned long)i, RecycleMagic);
+
+                        if(!fq->Push(elem_node)) {
+                            // the queue holds as many nodes as the pool
+                            errors.fetch_add(1u, std::memory_order_relaxed);
+                        }
+                    }
+
+                    if(fq->Pop(&elem_node)) {
+                        Element *e = free_allocate->AccessElementPointerAt(elem_node);
+
+                        if(e->counter != RecycleMagic || e->payload.size() != 2u) {
+                            errors.fetch_add(1u, std::memory_order_relaxed);
+                        }
+
+                        free_allocate->DestructAt(elem_node);
+                        free_allocate->Deallocate(elem_node);
+                    }
+                }
+                });
+    }
+
+    for(size_t i = 0; i < workers.size(); ++i) {
+        workers[i].join();
+    }
+
+    ElementFreeNode *elem_node;
+
+    while(fq->Pop(&elem_node)) {
+        free_allocate->DestructAt(elem_node);
+        free_allocate->Deallocate(elem_node);
+    }
+
+    // conservation: every node is back, and none twice
+    std::vector<ElementFreeNode *> nodes;
+
+    while((elem_node = free_allocate->Allocate())) {
+        nodes.push_back(elem_node);
+    }
+
+    size_t allocated = nodes.size();
+    std::sort(nodes.begin(), nodes.end());
+    bool distinct = std::adjacent_find(nodes.begin(), nodes.end()) == nodes.end();
+
+    for(size_t i = 0; i < nodes.size(); ++i) {
+        free_allocate->Deallocate(nodes[i]);
+    }
+
+    bool ok = !errors.load() && allocated == Capacity && distinct;
+
+    printf("%s %-32s threads=%d errors=%llu allocatable=%lu/%lu distinct=%d\n",
+            ok ? "PASS" : "FAIL", name, threads, errors.load(), (unsigned long)allocated,
+            (unsigned long)Capacity, (int)distinct);
+    fflush(stdout);
+
+    return ok;
+}
+
+int main(int argc, char **argv) {
+    unsigned long n = argc > 1 ? strtoul(argv[1], nullptr, 10) : 100000;
+    bool ok = true;
+
+    static constexpr size_t Capacity = 1000;
+
+    ok &= Fifo<FixedQueue<Element, Capacity>, false>("fixed_queue rwref", 2, 2, n);
+    ok &= Fifo<FixedQueue<Element, Capacity, FixedQueueSequenceOptions>>("fixed_queue sequence", 2, 2, n);
+    ok &= Fifo<FixedQueue<Element, Capacity, FixedQueueInterleavedOptions>, false>("fixed_queue interleaved", 2, 2, n);
+    ok &= Fifo<FixedQueue<Element, Capacity, FixedQueueSpscOptions>>("fixed_queue spsc", 1, 1, n);
+    ok &= Fifo<FixedQueue<Element, Capacity, FixedQueueMpscOptions>>("fixed_queue mpsc", 2, 1, n);
+    ok &= Fifo<FixedQueue<Element, Capacity, FixedQueueSpmcOptions>>("fixed_queue spmc", 1, 2, n);
+    ok &= Fifo<FixedQueue<Element, FixedQueueDynamicCapacity>, false>("fixed_queue dynamic", 2, 2, n, Capacity);
+    ok &= Fifo<FixedQueue<Element, Capacity, FixedQueueTicketOptions>>("fixed_queue ticket", 2, 2, n);
+    ok &= Fifo<FixedQueue<Element, Capacity, FixedQueueTicketOptions>>("fixed_queue ticket 4x4", 4, 4, n);
+    // nearly always full or empty: many pos are given up and skipped
+    ok &= Fifo<FixedQueue<Element, 7, FixedQueueTicketOptions>>("fixed_queue ticket capacity 7", 4, 4, n);
+    ok &= Fifo<FixedQueue<Element, 7, FixedQueueTicketRoundUpOptions>>("fixed_queue ticket round up 7", 4, 4, n);
+    ok &= Bound<FixedQueue<Element, 7, FixedQueueTicketRoundUpOptions>>("fixed_queue ticket round up 7", 4, n / 100u + 1u, 7);
+    ok &= Bound<FixedQueue<Element, 7, FixedQueueSequenceRoundUpOptions>>("fixed_queue sequence round up 7", 4, n / 100u + 1u, 7);
+    ok &= Fifo<FixedQueue<Element, Capacity, FixedQueueParkOptions>>("fixed_queue spin park", 2, 2, n);
+
+    ok &= Fifo<LinkedQueue<Element>>("linked_queue", 2, 2, n, Capacity);
+    ok &= Fifo<LinkedQueue<Element, false>>("linked_queue single reader", 2, 1, n, Capacity);
+    ok &= Fifo<LinkedQueue<Element, true, LinkedQueueMagazineOptions>>("linked_queue magazine", 2, 2, n, Capacity);
+    ok &= Fifo<LinkedQueue<Element, true, LinkedQueueCompactOptions>>("linked_queue compact", 2, 2, n, Capacity);
+    ok &= Fifo<LinkedQueue<Element, true, LinkedQueueReclaimOptions>>("linked_queue reclaim", 2, 2, n, Capacity);
+    ok &= Fifo<LinkedQueue<Element, true, LinkedQueueUnboundedOptions>>("linked_queue unbounded", 2, 2, n, Capacity);
+    ok &= Fifo<LinkedQueue<Element, true, LinkedQueuePauseOptions>>("linked_queue exponential pause", 2, 2, n, Capacity);
+
+    ok &= Fifo<ShardedQueue<FixedQueue<Element, FixedQueueDynamicCapacity, FixedQueueSequenceOptions>>>("sharded_queue", 2, 2, n, Capacity, 4);
+    ok &= Fifo<ShardedQueue<FixedQueue<Element, FixedQueueDynamicCapacity, FixedQueueTicketOptions>, ShardedQueueCpuGroupOptions>>("sharded_queue cpu group", 2, 2, n, Capacity, 4);
+
+    ok &= Fifo<IntrusiveAdapter<true>>("intrusive_queue multi reader", 2, 2, n);
+    ok &= Fifo<IntrusiveAdapter<false>>("intrusive_queue", 2, 1, n);
+
+    ok &= Steal<WorkStealingDequeDefaultOptions>("work_stealing_deque", 3, n);
+    ok &= Steal<WorkStealingDequeFixedOptions>("work_stealing_deque fixed", 3, n);
+
+    ok &= Broadcast<BroadcastRingDefaultOptions>("broadcast_ring block writer", 2, 3, n);
+    ok &= Broadcast<BroadcastRingOverwriteOptions>("broadcast_ring overwrite", 2, 3, n);
+
+    ok &= Recycle<FreeAllocate<Element>>("free_allocate recycle", 4, n);
+    ok &= Recycle<FreeAllocate<Element, FreeAllocateMagazineOptions>>("free_allocate magazine", 4, n);
+    ok &= Recycle<FreeAllocate<Element, FreeAllocateCompactOptions>>("free_allocate compact", 4, n);
+
+    printf("%s\n", ok ? "ALL PASSED" : "FAILED");
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,219 @@
+#include "work_stealing_deque.h"
+#include "fixed_queue.h"
+#include "free_allocate.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread>
+#include <vector>
+#include <memory>
+#include <chrono>
+
+// usage: work_stealing_bench.out [depth] [max_threads]
+//
+// a small thread pool running a fork tree: a task of depth d spawns two tasks of depth
+// d - 1, 2^(depth + 1) - 1 tasks in all. tasks come from one FreeAllocate pool and go
+// back to it when run. work_stealing: every worker pushes to and pops from its own
+// WorkStealingDeque, idle workers steal from the others. shared_*: every worker pushes
+// to and pops from one FixedQueue. a task that can not be pushed is run by its worker.
+// tasks/sec is the whole tree over the wall time of the run
+
+struct Task {
+    int depth;
+};
+
+using TaskPool = FreeAllocate<Task, FreeAllocateMagazineOptions>;
+
+// completed count of one worker, padded so counting does not share lines
+struct alignas(CacheLineSize) WorkerCount {
+    std::atomic<unsigned long long> completed = ATOMIC_VAR_INIT(0);
+};
+
+static Task *CreateTask(TaskPool &pool, int depth) {
+    auto *elem_node = pool.Allocate();
+
+    if(!elem_node) {
+        return nullptr;
+    }
+
+    pool.ConstructAt(elem_node, Task{depth});
+    return pool.AccessElementPointerAt(elem_node);
+}
+
+static void FreeTask(TaskPool &pool, Task *task) {
+    auto *elem_node = pool.AccessElementFreeNodeOf(task);
+
+    pool.DestructAt(elem_node);
+    pool.Deallocate(elem_node);
+}
+
+static unsigned long long TotalCompleted(const std::vector<WorkerCount> &counts) {
+    unsigned long long total = 0;
+
+    for(size_t i = 0; i < counts.size(); ++i) {
+        total += counts[i].completed.load(std::memory_order_relaxed);
+    }
+
+    return total;
+}
+
+// one executor over a Scheduler with Push(worker, task), Pop(worker, &task). run the
+// tree, return seconds
+template<typename Scheduler>
+static double Execute(Scheduler &scheduler, TaskPool &pool, int threads, int depth) {
+    unsigned long long expected = (2ull << depth) - 1u;
+
+    std::vector<WorkerCount> counts(threads);
+    std::atomic<int> start = ATOMIC_VAR_INIT(0);
+    std::vector<std::thread> workers;
+
+    for(int i = 0; i < threads; ++i) {
+        workers.emplace_back([&, i]() {
+                std::atomic<unsigned long long> &completed = counts[i].completed;
+                std::vector<Task *> overflow;
+                Task *task;
+
+                while(!start.load(std::memory_order_acquire));
+
+                for(;;) {
+                    if(overflow.empty() && !scheduler.Pop(i, &task)) {
+                        if(TotalCompleted(counts) == expected) {
+                            break;
+                        }
+
+                        continue;
+                    }
+
+                    if(!overflow.empty()) {
+                        task = overflow.back();
+                        overflow.pop_back();
+                    }
+
+                    for(int child = 0; task->depth > 0 && child < 2; ++child) {
+                        Task *spawned = CreateTask(pool, task->depth - 1);
+
+                        if(!spawned) {
+                            fprintf(stderr, "task pool exhausted\n");
+                            abort();
+                        }
+
+                        // children that can not be scheduled run here
+                        if(!scheduler.Push(i, spawned)) {
+                            overflow.push_back(spawned);
+                        }
+                    }
+
+                    FreeTask(pool, task);
+                    completed.store(completed.load(std::memory_order_relaxed) + 1u, std::memory_order_relaxed);
+                }
+                });
+    }
+
+    auto begin = std::chrono::steady_clock::now();
+
+    if(!scheduler.Push(0, CreateTask(pool, depth))) {
+        fprintf(stderr, "root task not scheduled\n");
+        abort();
+    }
+
+    start.store(1, std::memory_order_release);
+
+    for(size_t i = 0; i < workers.size(); ++i) {
+        workers[i].join();
+    }
+
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+}
+
+// per worker deques, a worker with an empty deque steals round robin from the next ones
+class WorkStealingScheduler {
+public:
+    WorkStealingScheduler(int threads, size_t capacity) {
+        for(int i = 0; i < threads; ++i) {
+            m_deques.emplace_back(std::make_unique<WorkStealingDeque<Task *>>(capacity));
+        }
+    }
+
+    bool Push(int worker, Task *task) {
+        return m_deques[worker]->Push(task);
+    }
+
+    bool Pop(int worker, Task **task) {
+        if(m_deques[worker]->Pop(task)) {
+            return true;
+        }
+
+        for(size_t i = 1; i < m_deques.size(); ++i) {
+            if(m_deques[(worker + i) % m_deques.size()]->Steal(task)) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+private:
+    std::vector<std::unique_ptr<WorkStealingDeque<Task *>>> m_deques;
+};
+
+template<typename Options>
+class SharedQueueScheduler {
+public:
+    SharedQueueScheduler(int, size_t capacity) : m_queue(std::make_unique<FixedQueue<Task *, FixedQueueDynamicCapacity, Options>>(capacity)) {}
+
+    bool Push(int, Task *task) {
+        return m_queue->Push(task);
+    }
+
+    bool Pop(int, Task **task) {
+        return m_queue->Pop(task);
+    }
+
+private:
+    std::unique_ptr<FixedQueue<Task *, FixedQueueDynamicCapacity, Options>> m_queue;
+};
+
+template<typename Scheduler>
+static void Run(const char *name, int threads, int depth, size_t capacity) {
+    size_t tasks = (size_t)2u << depth;
+    // the whole tree may be live at once, e.g. with one worker
+    TaskPool pool(tasks);
+    Scheduler scheduler(threads, capacity);
+
+    double elapsed = Execute(scheduler, pool, threads, depth);
+
+    printf("%-16s threads=%-4d tasks=%-10lu tasks/sec=%.0f\n", name, threads, (unsigned long)(tasks - 1u), (tasks - 1u) / elapsed);
+    fflush(stdout);
+}
+
+int main(int argc, char **argv) {
+    int depth = argc > 1 ? atoi(argv[1]) : 20;
+    int max_threads = argc > 2 ? atoi(argv[2]) : (int)std::thread::hardware_concurrency();
+
+    if(depth < 1 || depth > 30) {
+        depth = 20;
+    }
+
+    if(max_threads < 1) {
+        max_threads = 1;
+    }
+
+    printf("== fork tree, depth=%d ==\n", depth);
+
+    for(int threads = 1; ; threads *= 2) {
+        if(threads > max_threads) {
+            threads = max_threads;
+        }
+
+        // deques start small and grow, the shared queue is bounded at the tree size
+        Run<WorkStealingScheduler>("work_stealing", threads, depth, 256);
+        Run<SharedQueueScheduler<FixedQueueSequenceOptions>>("shared_sequence", threads, depth, (size_t)2u << depth);
+        Run<SharedQueueScheduler<FixedQueueTicketOptions>>("shared_ticket", threads, depth, (size_t)2u << depth);
+
+        if(threads == max_threads) {
+            break;
+        }
+    }
+
+    return 0;
+}
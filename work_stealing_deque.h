@@ -0,0 +1,233 @@
+#ifndef __WORK_STEALING_DEQUE_H__
+#define __WORK_STEALING_DEQUE_H__
+
+#include "cache_line.h"
+#include "mapped_memory.h"
+
+#include <atomic>
+#include <type_traits>
+#include <new>
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct WorkStealingDequeDefaultOptions {
+    // Push() on a full buffer moves the elements into one twice as big, false: Push()
+    // returns false instead
+    static constexpr bool Growable = true;
+};
+
+struct WorkStealingDequeFixedOptions : WorkStealingDequeDefaultOptions {
+    static constexpr bool Growable = false;
+};
+
+// Chase-Lev deque in the C11 form of Le, Pop, Cohen and Zappa Nardelli (PPoPP 2013).
+// one owner thread calls Push() and Pop() at the bottom, any thread calls Steal() at
+// the top. Push() is loads and stores only, Pop() adds one seq_cst store and needs a
+// CAS only for the last element, which it races thieves for. Steal() is one CAS.
+// elements are read before the CAS that claims them, so ElementType must be trivially
+// copyable, typically a pointer to a task.
+// a grown buffer may still be read by a thief that loaded it before, so replaced
+// buffers are kept until the destructor: all of them together are smaller than the
+// last one, and Steal() needs no pinning
+template<typename ElementType, typename Options = WorkStealingDequeDefaultOptions>
+class WorkStealingDeque {
+    static_assert(std::is_trivially_copyable<ElementType>::value, "ElementType is copied by racing threads, it must be trivially copyable");
+
+public:
+    // capacity is rounded up to a power of two. throw std::bad_alloc if the buffer can not be mapped
+    explicit WorkStealingDeque(size_t capacity = 1024, const MappedMemoryOptions &memory_options = MappedMemoryOptions()) :
+        m_memory_options(memory_options) {
+        Buffer *buffer = CreateBuffer(RoundUpPowerOfTwo(capacity), nullptr);
+
+        if(!buffer) {
+            throw std::bad_alloc();
+        }
+
+        m_buffer.store(buffer, std::memory_order_relaxed);
+    }
+
+    ~WorkStealingDeque() {
+        // elements are trivially destructible
+        for(Buffer *buffer = m_buffer.load(std::memory_order_relaxed); buffer; ) {
+            Buffer *replaced = buffer->replaced;
+
+            MappedMemoryFree(buffer->slots, buffer->mapped_bytes);
+            delete buffer;
+
+            buffer = replaced;
+        }
+    }
+
+    // owner only. false if the buffer is full and can not grow
+    bool Push(ElementType elem) {
+        int64_t bottom = m_bottom.load(std::memory_order_relaxed);
+        int64_t top = m_top.load(std::memory_order_acquire);
+        Buffer *buffer = m_buffer.load(std::memory_order_relaxed);
+
+        if(bottom - top > (int64_t)buffer->mask) {
+            if constexpr (!Options::Growable) {
+                return false;
+            }
+
+            buffer = Grow(buffer, top, bottom);
+
+            if(!buffer) {
+                return false;
+            }
+        }
+
+        buffer->Put(bottom, elem);
+
+        // the element is visible to a thief that sees the new bottom
+        m_bottom.store(bottom + 1, std::memory_order_release);
+
+        return true;
+    }
+
+    // owner only. newest element first
+    bool Pop(ElementType *out) {
+        int64_t bottom = m_bottom.load(std::memory_order_relaxed) - 1;
+        Buffer *buffer = m_buffer.load(std::memory_order_relaxed);
+
+        // seq_cst: a thief reads top before bottom, so either it sees this bottom,
+        // or we see its top below
+        m_bottom.store(bottom, std::memory_order_seq_cst);
+
+        int64_t top = m_top.load(std::memory_order_seq_cst);
+
+        if(top > bottom) {
+            // deque is empty
+            m_bottom.store(bottom + 1, std::memory_order_relaxed);
+            return false;
+        }
+
+        ElementType elem = buffer->Get(bottom);
+
+        if(top == bottom) {
+            // last element, a thief may take it at the same time
+            bool ok = m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+
+            m_bottom.store(bottom + 1, std::memory_order_relaxed);
+
+            if(!ok) {
+                return false;
+            }
+        }
+
+        *out = elem;
+        return true;
+    }
+
+    // any thread. oldest element first. false if the deque is empty or another thief
+    // or the owner took the element first
+    bool Steal(ElementType *out) {
+        int64_t top = m_top.load(std::memory_order_seq_cst);
+        int64_t bottom = m_bottom.load(std::memory_order_seq_cst);
+
+        if(top >= bottom) {
+            // deque is empty
+            return false;
+        }
+
+        // acquire: pairs with the release store of a grown buffer
+        Buffer *buffer = m_buffer.load(std::memory_order_acquire);
+        ElementType elem = buffer->Get(top);
+
+        if(!m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+            return false;
+        }
+
+        *out = elem;
+        return true;
+    }
+
+    size_t ApproximateSize() const {
+        int64_t size = m_bottom.load(std::memory_order_relaxed) - m_top.load(std::memory_order_relaxed);
+
+        return size > 0 ? (size_t)size : 0;
+    }
+
+    bool Empty() const {
+        return ApproximateSize() == 0;
+    }
+
+    // slots of the current buffer
+    size_t GetCapacity() const {
+        return m_buffer.load(std::memory_order_relaxed)->mask + 1u;
+    }
+
+private:
+    WorkStealingDeque(const WorkStealingDeque &);
+    WorkStealingDeque(WorkStealingDeque &&);
+    WorkStealingDeque &operator=(const WorkStealingDeque &);
+    WorkStealingDeque &operator=(WorkStealingDeque &&);
+
+    // slots are atomics: a thief may read a slot the owner is writing, its CAS then fails
+    struct Buffer {
+        std::atomic<ElementType> *slots;
+        size_t mask;
+        size_t mapped_bytes;
+        Buffer *replaced; // the smaller buffer this one replaced
+
+        ElementType Get(int64_t pos) const {
+            return slots[(size_t)pos & mask].load(std::memory_order_relaxed);
+        }
+
+        void Put(int64_t pos, ElementType elem) {
+            slots[(size_t)pos & mask].store(elem, std::memory_order_relaxed);
+        }
+    };
+
+    Buffer *CreateBuffer(size_t size, Buffer *replaced) {
+        size_t mapped_bytes;
+        void *p = MappedMemoryAllocate(size * sizeof(std::atomic<ElementType>), m_memory_options, &mapped_bytes);
+
+        if(!p) {
+            return nullptr;
+        }
+
+        Buffer *buffer = new (std::nothrow) Buffer();
+
+        if(!buffer) {
+            MappedMemoryFree(p, mapped_bytes);
+            return nullptr;
+        }
+
+        buffer->slots = (std::atomic<ElementType> *)p;
+        buffer->mask = size - 1u;
+        buffer->mapped_bytes = mapped_bytes;
+        buffer->replaced = replaced;
+
+        for(size_t i = 0; i < size; ++i) {
+            new (&buffer->slots[i]) std::atomic<ElementType>();
+        }
+
+        return buffer;
+    }
+
+    // owner only. copy [top, bottom) into a buffer twice as big, nullptr if it can not be mapped
+    Buffer *Grow(Buffer *buffer, int64_t top, int64_t bottom) {
+        Buffer *grown = CreateBuffer((buffer->mask + 1u) * 2u, buffer);
+
+        if(!grown) {
+            return nullptr;
+        }
+
+        for(int64_t pos = top; pos < bottom; ++pos) {
+            grown->Put(pos, buffer->Get(pos));
+        }
+
+        // a thief loading the new buffer sees the copied elements
+        m_buffer.store(grown, std::memory_order_release);
+
+        return grown;
+    }
+
+    alignas(CacheLineSize) std::atomic<int64_t> m_top = ATOMIC_VAR_INIT(0); // next pos to steal
+    alignas(CacheLineSize) std::atomic<int64_t> m_bottom = ATOMIC_VAR_INIT(0); // next pos to push
+    std::atomic<Buffer *> m_buffer = ATOMIC_VAR_INIT(nullptr);
+    MappedMemoryOptions m_memory_options;
+};
+
+#endif
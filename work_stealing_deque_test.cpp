@@ -0,0 +1,134 @@
+#include "work_stealing_deque.h"
+
+#include <vector>
+#include <thread>
+
+#include <signal.h>
+
+// the owner pushes 1, 2, 3 ... and pops some of them back, thieves steal the rest.
+// every value is taken exactly once: count and sum of taken values match the pushed
+// ones. a thief always takes the oldest element, so its values increase. the deque
+// starts at 16 slots and grows while thieves read the old buffers
+
+static constexpr int Thieves = 3;
+
+static std::atomic<int> stop = ATOMIC_VAR_INIT(0);
+
+static void sig_handler(int sig) {
+    stop.store(1, std::memory_order_relaxed);
+}
+
+struct Taken {
+    unsigned long long count = 0;
+    unsigned long long sum = 0;
+};
+
+int main() {
+    signal(SIGINT, sig_handler);
+    signal(SIGTERM, sig_handler);
+
+    WorkStealingDeque<unsigned long> deque(16);
+    WorkStealingDeque<unsigned long, WorkStealingDequeFixedOptions> fixed_deque(64);
+
+    std::atomic<int> owner_done = ATOMIC_VAR_INIT(0);
+    std::atomic<unsigned long long> errors(0);
+    std::vector<Taken> stolen(Thieves);
+    Taken pushed;
+    Taken popped;
+    unsigned long long fixed_full = 0;
+
+    std::vector<std::thread> thieves;
+
+    for(int i = 0; i < Thieves; ++i) {
+        thieves.emplace_back([&, i]() {
+                unsigned long last = 0;
+                unsigned long v;
+
+                for(;;) {
+                    if(deque.Steal(&v)) {
+                        if(v <= last) {
+                            errors.fetch_add(1u, std::memory_order_relaxed);
+                        }
+
+                        last = v;
+                        ++stolen[i].count;
+                        stolen[i].sum += v;
+                    } else if(fixed_deque.Steal(&v)) {
+                        // its own counting is not needed, it only must not lose or duplicate
+                        ++stolen[i].count;
+                        stolen[i].sum += v;
+                    } else if(owner_done.load(std::memory_order_acquire)) {
+                        break;
+                    }
+                }
+                });
+    }
+
+    unsigned long value = 0;
+    unsigned long v;
+
+    while(!stop.load(std::memory_order_relaxed)) {
+        // bursts, so the deque both grows and runs empty
+        for(int i = 0; i < 100; ++i) {
+            ++value;
+
+            if(deque.Push(value)) {
+                ++pushed.count;
+                pushed.sum += value;
+            } else {
+                errors.fetch_add(1u, std::memory_order_relaxed);
+            }
+
+            if(value % 3 == 0) {
+                if(fixed_deque.Push(value)) {
+                    ++pushed.count;
+                    pushed.sum += value;
+                } else {
+                    ++fixed_full;
+                }
+            }
+        }
+
+        for(int i = 0; i < 60; ++i) {
+            if(deque.Pop(&v)) {
+                ++popped.count;
+                popped.sum += v;
+            }
+
+            if(i % 2 && fixed_deque.Pop(&v)) {
+                ++popped.count;
+                popped.sum += v;
+            }
+        }
+    }
+
+    // what the thieves leave behind
+    while(deque.Pop(&v) || fixed_deque.Pop(&v)) {
+        ++popped.count;
+        popped.sum += v;
+    }
+
+    owner_done.store(1, std::memory_order_release);
+
+    for(size_t i = 0; i < thieves.size(); ++i) {
+        thieves[i].join();
+    }
+
+    Taken taken = popped;
+
+    for(int i = 0; i < Thieves; ++i) {
+        printf("thief %d stolen=%llu\n", i, stolen[i].count);
+        taken.count += stolen[i].count;
+        taken.sum += stolen[i].sum;
+    }
+
+    printf("pushed=%llu, popped=%llu, taken=%llu, capacity=%lu, fixed_full=%llu, errors=%llu\n",
+            pushed.count, popped.count, taken.count, (unsigned long)deque.GetCapacity(), fixed_full, errors.load());
+
+    if(taken.count != pushed.count || taken.sum != pushed.sum || errors.load() || !deque.Empty()) {
+        fprintf(stderr, "FAILED\n");
+        return 1;
+    }
+
+    return 0;
+}